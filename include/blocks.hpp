@@ -0,0 +1,343 @@
+/*
+ *  blocks.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef BLOCKS_HPP
+#define BLOCKS_HPP
+
+#include "graph_type.hpp"
+#include "utility/gmp.hpp"
+#include "utility/polynomial_two.hpp"
+
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Factorization over blocks (biconnected components). If G is made of
+// G1 and G2 sharing a single vertex, a set of edges of G is one of G1
+// and one of G2, whose components are those of both but for the shared
+// vertex, which is counted twice, so that Z(G) = Z(G1) Z(G2) / Q. If
+// they share no vertex Z(G) = Z(G1) Z(G2). So, splitting a graph at
+// its cut vertices into a graph H, the disjoint union of its blocks,
+//
+//   Z(G) = Z(H) / Q^(blocks - components)
+//
+// and H has smaller tree decompositions: its width is that of the
+// widest block, its bags do not carry the cut vertices across blocks,
+// and the blocks are separate subtrees, transferred in parallel (see
+// build_tree_decomposition for graphs that are not connected).
+
+namespace blocks {
+
+  struct stats {
+    std::size_t blocks;      // isolated vertices included
+    std::size_t components;
+    std::size_t largest_vertices, largest_edges;
+  };
+
+  // Returns H, with the vertices of each block numbered consecutively,
+  // blocks in the order in which a depth first search closes them and
+  // the vertices of a block in their order in g. A cut vertex is copied
+  // in each of its blocks. Loops go to a block of their vertex, a
+  // vertex with loops only being a block of its own.
+  inline graph_type split(graph_type const& g, stats& s)
+  {
+    using boost::vertex_index;
+    unsigned int const n = num_vertices(g);
+    unsigned int const none = -1;
+
+    std::vector<std::pair<unsigned int, unsigned int> > edge;
+    graph_type::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      edge.emplace_back(get(vertex_index, g, source(*ei, g)),
+        get(vertex_index, g, target(*ei, g)));
+    }
+    unsigned int const m = edge.size();
+
+    // adjacency in compressed form, (neighbour, edge) pairs, no loops
+    std::vector<std::size_t> offset(n + 1, 0);
+    for (auto const& e : edge) {
+      if (e.first != e.second) {
+        ++ offset[e.first + 1];
+        ++ offset[e.second + 1];
+      }
+    }
+    for (unsigned int v = 0; v < n; ++v)
+      offset[v + 1] += offset[v];
+    std::vector<std::pair<unsigned int, unsigned int> > adjacent(offset[n]);
+    {
+      std::vector<std::size_t> next(offset.begin(), offset.end() - 1);
+      for (unsigned int k = 0; k < m; ++k) {
+        auto const& e = edge[k];
+        if (e.first != e.second) {
+          adjacent[next[e.first]++] = std::make_pair(e.second, k);
+          adjacent[next[e.second]++] = std::make_pair(e.first, k);
+        }
+      }
+    }
+
+    // Hopcroft and Tarjan, with an explicit stack: a block is closed
+    // when the search returns from a child to a vertex, if no edge
+    // leads from below the child to above the vertex
+    std::vector<unsigned int> block(m, none);
+    std::vector<unsigned int> first_block(n, none);
+    std::vector<unsigned int> discovery(n, none), low(n, 0);
+    std::vector<unsigned int> edge_stack;
+    struct frame {
+      unsigned int vertex, via;  // the edge from the parent
+      std::size_t next;          // position in the adjacency
+    };
+    std::vector<frame> stack;
+    unsigned int time = 0, count = 0;
+    s.components = 0;
+    for (unsigned int root = 0; root < n; ++root) {
+      if (discovery[root] != none)
+        continue;
+      ++ s.components;
+      discovery[root] = low[root] = time++;
+      stack.push_back(frame{root, none, offset[root]});
+      while (not stack.empty()) {
+        frame& f = stack.back();
+        unsigned int const v = f.vertex;
+        if (f.next < offset[v + 1]) {
+          auto const a = adjacent[f.next++];
+          unsigned int const w = a.first;
+          if (discovery[w] == none) {
+            edge_stack.push_back(a.second);
+            discovery[w] = low[w] = time++;
+            stack.push_back(frame{w, a.second, offset[w]});
+          } else if (a.second != f.via and discovery[w] < discovery[v]) {
+            edge_stack.push_back(a.second);
+            low[v] = std::min(low[v], discovery[w]);
+          }
+          continue;
+        }
+        unsigned int const via = f.via;
+        stack.pop_back();
+        if (stack.empty())
+          break;
+        unsigned int const u = stack.back().vertex;
+        low[u] = std::min(low[u], low[v]);
+        if (low[v] >= discovery[u]) {
+          unsigned int k;
+          do {
+            k = edge_stack.back();
+            edge_stack.pop_back();
+            block[k] = count;
+          } while (k != via);
+          ++ count;
+        }
+      }
+    }
+
+    for (unsigned int k = 0; k < m; ++k) {
+      auto const& e = edge[k];
+      if (block[k] != none) {
+        if (first_block[e.first] == none)
+          first_block[e.first] = block[k];
+        if (first_block[e.second] == none)
+          first_block[e.second] = block[k];
+      }
+    }
+    // vertices without edges to others are blocks of their own
+    for (unsigned int v = 0; v < n; ++v) {
+      if (first_block[v] == none)
+        first_block[v] = count++;
+    }
+    for (unsigned int k = 0; k < m; ++k) {
+      if (block[k] == none)
+        block[k] = first_block[edge[k].first];
+    }
+
+    // the vertices of each block, in their order in g
+    std::vector<std::vector<unsigned int> > members(count);
+    for (unsigned int k = 0; k < m; ++k) {
+      members[block[k]].push_back(edge[k].first);
+      members[block[k]].push_back(edge[k].second);
+    }
+    for (unsigned int v = 0; v < n; ++v)
+      members[first_block[v]].push_back(v);
+    std::vector<std::size_t> base(count + 1, 0);
+    for (unsigned int b = 0; b < count; ++b) {
+      auto& x = members[b];
+      std::sort(x.begin(), x.end());
+      x.erase(std::unique(x.begin(), x.end()), x.end());
+      base[b + 1] = base[b] + x.size();
+    }
+    auto label = [&](unsigned int b, unsigned int v) {
+      auto const& x = members[b];
+      return base[b] + (std::lower_bound(x.begin(), x.end(), v) - x.begin());
+    };
+
+    std::vector<std::pair<unsigned int, unsigned int> > edge_list;
+    std::vector<std::size_t> block_edges(count, 0);
+    for (unsigned int k = 0; k < m; ++k) {
+      unsigned int const b = block[k];
+      edge_list.emplace_back(label(b, edge[k].first), label(b, edge[k].second));
+      ++ block_edges[b];
+    }
+
+    s.blocks = count;
+    s.largest_vertices = s.largest_edges = 0;
+    for (unsigned int b = 0; b < count; ++b) {
+      if (members[b].size() > s.largest_vertices) {
+        s.largest_vertices = members[b].size();
+        s.largest_edges = block_edges[b];
+      }
+    }
+
+    boost::counting_iterator<int> ep_iter(0);
+    graph_type h(edge_list.begin(), edge_list.end(), ep_iter, base[count]);
+    unsigned int i = 0;
+    graph_type::vertex_iterator vi, vi_end;
+    for (boost::tie(vi, vi_end) = vertices(h); vi != vi_end; ++vi)
+      put(vertex_index, h, *vi, i++);
+    return h;
+  }
+
+  // Numbers the connected components of g from 0, in the order of
+  // their first vertex, setting the component of each vertex. Returns
+  // their number.
+  inline unsigned int components(graph_type const& g, std::vector<unsigned int>& label)
+  {
+    using boost::vertex_index;
+    unsigned int const n = num_vertices(g);
+    unsigned int const none = -1;
+    std::vector<std::vector<unsigned int> > adjacent(n);
+    graph_type::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      unsigned int const a = get(vertex_index, g, source(*ei, g));
+      unsigned int const b = get(vertex_index, g, target(*ei, g));
+      adjacent[a].push_back(b);
+      adjacent[b].push_back(a);
+    }
+    label.assign(n, none);
+    unsigned int count = 0;
+    std::vector<unsigned int> stack;
+    for (unsigned int r = 0; r < n; ++r) {
+      if (label[r] != none)
+        continue;
+      label[r] = count;
+      stack.assign(1, r);
+      while (not stack.empty()) {
+        unsigned int const v = stack.back();
+        stack.pop_back();
+        for (auto u : adjacent[v]) {
+          if (label[u] == none) {
+            label[u] = count;
+            stack.push_back(u);
+          }
+        }
+      }
+      ++ count;
+    }
+    return count;
+  }
+
+  // The subgraph of g on the vertices with keep set, numbered in their
+  // order in g.
+  inline graph_type induced(graph_type const& g, std::vector<bool> const& keep)
+  {
+    using boost::vertex_index;
+    unsigned int const n = num_vertices(g);
+    std::vector<unsigned int> label(n);
+    unsigned int k = 0;
+    for (unsigned int v = 0; v < n; ++v)
+      label[v] = keep[v] ? k++ : 0;
+    std::vector<std::pair<unsigned int, unsigned int> > edge_list;
+    graph_type::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      unsigned int const a = get(vertex_index, g, source(*ei, g));
+      unsigned int const b = get(vertex_index, g, target(*ei, g));
+      if (keep[a] and keep[b])
+        edge_list.emplace_back(label[a], label[b]);
+    }
+    boost::counting_iterator<int> ep_iter(0);
+    graph_type h(edge_list.begin(), edge_list.end(), ep_iter, k);
+    unsigned int i = 0;
+    graph_type::vertex_iterator vi, vi_end;
+    for (boost::tie(vi, vi_end) = vertices(h); vi != vi_end; ++vi)
+      put(vertex_index, h, *vi, i++);
+    return h;
+  }
+
+  // Orders each connected component of g on its own and returns the
+  // orders one after the other, on the vertices of g. order_of(h,
+  // share) returns an elimination order of the component h, share
+  // being its part of the vertices not ordered yet, for heuristics
+  // that spread a time limit. Eliminating a vertex touches only its
+  // own component, so the decomposition is that of each component as
+  // order_of would make it alone, where a heuristic run on the whole
+  // of H would weigh the blocks together.
+  template<class Order>
+  std::vector<unsigned int> order_components(graph_type const& g, Order order_of)
+  {
+    using boost::vertex_index;
+    std::vector<unsigned int> label;
+    unsigned int const count = components(g, label);
+    if (count <= 1)
+      return order_of(g, 1.0);
+
+    unsigned int const n = num_vertices(g);
+    std::vector<unsigned int> number(n);
+    std::vector<std::vector<unsigned int> > members(count);
+    for (unsigned int v = 0; v < n; ++v) {
+      number[v] = members[label[v]].size();
+      members[label[v]].push_back(v);
+    }
+    std::vector<std::vector<std::pair<unsigned int, unsigned int> > > edge_lists(count);
+    graph_type::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      unsigned int const a = get(vertex_index, g, source(*ei, g));
+      unsigned int const b = get(vertex_index, g, target(*ei, g));
+      edge_lists[label[a]].emplace_back(number[a], number[b]);
+    }
+
+    std::vector<unsigned int> order;
+    order.reserve(n);
+    unsigned int left = n;
+    for (unsigned int c = 0; c < count; ++c) {
+      boost::counting_iterator<int> ep_iter(0);
+      graph_type h(edge_lists[c].begin(), edge_lists[c].end(), ep_iter, members[c].size());
+      unsigned int i = 0;
+      graph_type::vertex_iterator vi, vi_end;
+      for (boost::tie(vi, vi_end) = vertices(h); vi != vi_end; ++vi)
+        put(vertex_index, h, *vi, i++);
+      std::vector<std::pair<unsigned int, unsigned int> >().swap(edge_lists[c]);
+      for (auto v : order_of(h, double(members[c].size()) / left))
+        order.push_back(members[c][v]);
+      left -= members[c].size();
+    }
+    return order;
+  }
+
+  // Z(G) from Z(H), as a polynomial
+  template<class T>
+  void divide_by_Q(polynomial_two<T>& z, unsigned int k)
+  {
+    z = z.divided_by_Q(k);
+  }
+
+  // Z(G) from Z(H), at a fixed value of Q (if Q = 0 both vanish)
+  inline void divide_by_Q(gmp::mpz_int& z, int Q, unsigned int k)
+  {
+    if (Q == 0)
+      return;
+    for (unsigned int i = 0; i < k; ++i)
+      z /= gmp::mpz_int(Q);
+  }
+}
+
+#endif
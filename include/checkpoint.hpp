@@ -0,0 +1,202 @@
+/*
+ *  checkpoint.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "tree_decomposition/tree_decomposition.hpp"
+#include "utility/arena.hpp"
+#include "utility/binary_io.hpp"
+
+#include <boost/cstdint.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Checkpoints of the projected tables of completed subtrees, so that an
+// interrupted run can be resumed. A checkpoint is keyed by a hash of
+// the whole tree decomposition (vertices, edges and shape, hence of the
+// graph and the elimination order), by the position of the bag in it
+// and by a signature of the operators (weight type, Q, v and for
+// modular weights the modulus).
+//
+// Files are written under a temporary name and renamed, so a file with
+// the right name is complete; they also start and end with a magic
+// number, to catch anything else.
+
+namespace checkpoint {
+  using tree_decomposition::bag_ptr;
+  using tree_decomposition::bag;
+
+  // FNV-1a, stable across builds and platforms
+  class hasher {
+    boost::uint64_t h_;
+  public:
+    hasher() : h_(14695981039346656037ull) {}
+
+    void add(void const* p, std::size_t n)
+    {
+      auto c = static_cast<unsigned char const*>(p);
+      for (std::size_t i = 0; i < n; ++i) {
+        h_ ^= c[i];
+        h_ *= 1099511628211ull;
+      }
+    }
+
+    void add(boost::uint32_t x) { add(&x, sizeof(x)); }
+    void add(std::string const& s) { add(s.data(), s.size()); }
+
+    boost::uint64_t value() const { return h_; }
+  };
+
+  inline std::string hex(boost::uint64_t x)
+  {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) x);
+    return buf;
+  }
+
+  class store {
+    static const boost::uint64_t magic = 0x31544e504b434b54ull;
+
+    std::string dir_;
+    std::string tree_hash_;
+    std::map<bag const*, unsigned int> ids_;
+
+    std::string path(bag_ptr b, std::string const& signature) const
+    {
+      hasher h;
+      h.add(signature);
+      return dir_ + "/" + tree_hash_ + "-" + hex(h.value()) + "-"
+        + std::to_string(ids_.at(b.get())) + ".ckpt";
+    }
+
+  public:
+    // bags are numbered in pre-order, the decomposition must not change
+    // afterwards
+    store(std::string const& dir, bag_ptr root)
+      : dir_(dir)
+    {
+      if (::mkdir(dir.c_str(), 0777) != 0 and errno != EEXIST)
+        throw std::runtime_error("cannot create checkpoint directory " + dir);
+
+      hasher h;
+      std::vector<bag_ptr> stack{root};
+      while (not stack.empty()) {
+        auto b = stack.back();
+        stack.pop_back();
+        unsigned int const id = ids_.size();
+        ids_[b.get()] = id;
+        h.add(boost::uint32_t(b->vertices.size()));
+        for (auto v : b->vertices)
+          h.add(v);
+        h.add(boost::uint32_t(b->edges.size()));
+        for (auto e : b->edges) {
+          h.add(e.first);
+          h.add(e.second);
+        }
+        h.add(boost::uint32_t(b->children.size()));
+        for (auto it = b->children.rbegin(); it != b->children.rend(); ++it)
+          stack.push_back(*it);
+      }
+      tree_hash_ = hex(h.value());
+    }
+
+    // whether a complete checkpoint exists for the subtree of b
+    bool exists(bag_ptr b, std::string const& signature) const
+    {
+      std::FILE* f = std::fopen(path(b, signature).c_str(), "rb");
+      if (not f)
+        return false;
+      boost::uint64_t head = 0, tail = 0;
+      bool ok = std::fread(&head, sizeof(head), 1, f) == 1
+        and std::fseek(f, -long(sizeof(tail)), SEEK_END) == 0
+        and std::fread(&tail, sizeof(tail), 1, f) == 1;
+      std::fclose(f);
+      return ok and head == magic and tail == magic;
+    }
+
+    // loads the checkpoint of b into a single shard of t, returns false
+    // if there is none
+    template<class Table>
+    bool load(bag_ptr b, std::string const& signature, Table& t) const
+    {
+      using binary_io::read_binary;
+      if (not exists(b, signature))
+        return false;
+      std::unique_ptr<std::FILE, int (*)(std::FILE*)> f(
+        std::fopen(path(b, signature).c_str(), "rb"), std::fclose);
+      if (not f)
+        return false;
+
+      Table tmp;
+      auto& out = tmp.shard(0);
+      memory::arena::scope scope(out.get_arena());
+      boost::uint64_t head, n;
+      read_binary(f.get(), head);
+      read_binary(f.get(), n);
+      out.reserve(n);
+      for (boost::uint64_t k = 0; k < n; ++k) {
+        typename Table::shard_type::key_type key;
+        typename Table::shard_type::mapped_type value;
+        read_binary(f.get(), key);
+        read_binary(f.get(), value);
+        out.emplace(std::move(key), std::move(value));
+      }
+      t = std::move(tmp);
+      return true;
+    }
+
+    template<class Table>
+    void save(bag_ptr b, std::string const& signature, Table const& t) const
+    {
+      using binary_io::write_binary;
+      std::string const target = path(b, signature);
+      std::string const tmp = target + ".tmp" + std::to_string(::getpid());
+      std::FILE* f = std::fopen(tmp.c_str(), "wb");
+      if (not f)
+        throw std::runtime_error("cannot write checkpoint " + tmp);
+      try {
+        write_binary(f, boost::uint64_t(magic));
+        write_binary(f, boost::uint64_t(t.size()));
+        t.for_each_shard([&](typename Table::shard_type const& s) {
+          for (auto const& e : s) {
+            write_binary(f, e.first);
+            write_binary(f, e.second);
+          }
+        });
+        write_binary(f, boost::uint64_t(magic));
+      } catch (...) {
+        std::fclose(f);
+        std::remove(tmp.c_str());
+        throw;
+      }
+      bool ok = std::fflush(f) == 0 and ::fsync(::fileno(f)) == 0;
+      ok = std::fclose(f) == 0 and ok;
+      if (not ok or std::rename(tmp.c_str(), target.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot write checkpoint " + target);
+      }
+    }
+  };
+}
+
+#endif
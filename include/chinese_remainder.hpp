@@ -13,8 +13,6 @@
 
 #ifndef CHINESE_REMAINDER_HPP
 
-#include "transfer.hpp"
-#include "tree_decomposition/tree_decomposition.hpp"
 #include "utility/gmp.hpp"
 #include "utility/polynomial_two.hpp"
 #include "utility/Zp.hpp"
@@ -35,8 +33,6 @@ namespace chinese_remainder {
 
   using gmp::mpz_int;
 
-  using tree_decomposition::bag_ptr;
-
   template<typename T>
   void check_and_wrap(T& t, mpz_int const& pp)
   {
@@ -55,11 +51,14 @@ namespace chinese_remainder {
     }
   }
 
-  template<template<class> class Algorithm, class... Args>
-  void chinese_remainder(bag_ptr t, Args&&... args)
+  // Runs c.template run<Small>() modulo more and more primes, until
+  // the result reconstructed from the residues stops changing. Small is
+  // the weight type Big with its mpz_int coefficients taken as Zp.
+  template<class Big, class Small, class Computation>
+  Big chinese_remainder(Computation const& c)
   {
     using modular::Zp;
-    using big_t = typename Algorithm<mpz_int>::weight_type;
+    using big_t = Big;
 
     unsigned int k = 0;
     big_t partial_results[num_primes];
@@ -69,7 +68,6 @@ namespace chinese_remainder {
 
     do {
       Zp::set_modulus(primes[k]);
-      Algorithm<Zp> algo(std::forward<Args>(args)...);
 
       pp *= primes[k];
 
@@ -78,7 +76,7 @@ namespace chinese_remainder {
 
       result_last = result;
 
-      partial_results[k] = big_t(transfer::transfer(algo, t));
+      partial_results[k] = big_t(c.template run<Small>());
       std::cerr << "result (mod " << Zp::get_modulus() << ")\t: " << partial_results[k] << "\n";
 
       result = std::inner_product(partial_results, partial_results + k + 1, qs, big_t(0));
@@ -87,7 +85,7 @@ namespace chinese_remainder {
 
       ++ k;
     } while (result != result_last);
-    std::cout << result << "\n";
+    return result;
   }
 }
 
@@ -0,0 +1,294 @@
+/*
+ *  conditioning.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef CONDITIONING_HPP
+#define CONDITIONING_HPP
+
+#include "graph_type.hpp"
+#include "preprocess.hpp"
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/heuristics.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// Conditioning on a set S of edges. Splitting the sum over A by the
+// edges of S it holds,
+//
+//   Z(G) = sum_{B subset of S} v^|B| Z((G - S) / B)
+//
+// where (G - S) / B is G without the edges of S and with the vertices
+// joined by B identified: the components of A and B together are those
+// of A in the quotient. Many sets B give the same quotient (those with
+// the same connected classes), so the sum is over the quotients, each
+// weighing a polynomial in v. Their decompositions may be narrower than
+// that of G: the quotient is a minor of G - (S \ B), which lacks the
+// edges S \ B. Each quotient is an independent run of the transfer.
+
+namespace conditioning {
+
+  // a quotient, by the smallest vertex of the class of each vertex of
+  // G, and the number of sets B of each size giving it
+  struct subproblem {
+    std::vector<unsigned int> root;
+    std::vector<std::size_t> contracted;
+  };
+
+  namespace detail {
+    typedef std::vector<std::pair<unsigned int, unsigned int> > edge_vector;
+
+    inline edge_vector edge_list(graph_type const& g)
+    {
+      using boost::vertex_index;
+      edge_vector e;
+      graph_type::edge_iterator ei, ei_end;
+      for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+        e.emplace_back(get(vertex_index, g, source(*ei, g)),
+          get(vertex_index, g, target(*ei, g)));
+      }
+      return e;
+    }
+
+    inline unsigned int find(std::vector<unsigned int>& parent, unsigned int x)
+    {
+      while (parent[x] != x)
+        x = parent[x] = parent[parent[x]];
+      return x;
+    }
+
+    inline graph_type quotient(unsigned int n, edge_vector const& e,
+      std::vector<unsigned int> const& chosen, subproblem const& s)
+    {
+      std::vector<bool> removed(e.size(), false);
+      for (auto k : chosen)
+        removed[k] = true;
+      std::vector<unsigned int> label(n);
+      unsigned int count = 0;
+      for (unsigned int v = 0; v < n; ++v)
+        label[v] = s.root[v] == v ? count++ : label[s.root[v]];
+      edge_vector edge_list;
+      for (std::size_t k = 0; k < e.size(); ++k) {
+        if (not removed[k])
+          edge_list.emplace_back(label[e[k].first], label[e[k].second]);
+      }
+      boost::counting_iterator<int> ep_iter(0);
+      graph_type h(edge_list.begin(), edge_list.end(), ep_iter, count);
+      unsigned int i = 0;
+      graph_type::vertex_iterator vi, vi_end;
+      for (boost::tie(vi, vi_end) = vertices(h); vi != vi_end; ++vi)
+        put(boost::vertex_index, h, *vi, i++);
+      return h;
+    }
+
+    inline std::vector<subproblem> enumerate(unsigned int n, edge_vector const& e,
+      std::vector<unsigned int> const& chosen)
+    {
+      std::map<std::vector<unsigned int>, subproblem> found;
+      std::vector<unsigned int> parent(n);
+      unsigned int const k = chosen.size();
+      for (unsigned long b = 0; b < (1ul << k); ++b) {
+        std::iota(parent.begin(), parent.end(), 0);
+        unsigned int size = 0;
+        for (unsigned int i = 0; i < k; ++i) {
+          if (b >> i & 1) {
+            ++ size;
+            unsigned int x = find(parent, e[chosen[i]].first);
+            unsigned int y = find(parent, e[chosen[i]].second);
+            if (x > y)
+              std::swap(x, y);
+            parent[y] = x;
+          }
+        }
+        // only the ends of the edges of S can be joined
+        std::vector<unsigned int> key;
+        for (auto c : chosen) {
+          key.push_back(find(parent, e[c].first));
+          key.push_back(find(parent, e[c].second));
+        }
+        subproblem& s = found[key];
+        if (s.root.empty()) {
+          s.root.resize(n);
+          for (unsigned int v = 0; v < n; ++v)
+            s.root[v] = find(parent, v);
+        }
+        if (s.contracted.size() <= size)
+          s.contracted.resize(size + 1, 0);
+        ++ s.contracted[size];
+      }
+      std::vector<subproblem> r;
+      for (auto& x : found)
+        r.push_back(std::move(x.second));
+      return r;
+    }
+
+    // width and estimated work of the subproblems, reduced as main
+    // does and with the greedy degree order
+    struct score {
+      unsigned int width;
+      double work;
+      std::size_t widest;  // the subproblem of largest width
+
+      bool operator<(score const& o) const
+      {
+        return width < o.width or (width == o.width and work < o.work);
+      }
+    };
+
+    // on the vertices of the reduced graph, kept[i] being that of g
+    // of vertex i
+    inline tree_decomposition::bag_ptr decompose(graph_type const& g,
+      std::vector<unsigned int>* kept = nullptr)
+    {
+      preprocess::edge_weights w;
+      graph_type const h = preprocess::reduce(g, w, false, nullptr, kept);
+      std::vector<unsigned int> order(num_vertices(h));
+      heuristics::greedy_degree_order(h, order.begin());
+      return tree_decomposition::build_tree_decomposition(order, h);
+    }
+
+    inline score evaluate(unsigned int n, edge_vector const& e,
+      std::vector<unsigned int> const& chosen)
+    {
+      auto const subproblems = enumerate(n, e, chosen);
+      score s{0, 0.0, 0};
+      for (std::size_t i = 0; i < subproblems.size(); ++i) {
+        auto const td = decompose(quotient(n, e, chosen, subproblems[i]));
+        unsigned int const width = max_bag_size(td) - 1;
+        if (i == 0 or width > s.width) {
+          s.width = width;
+          s.widest = i;
+        }
+        s.work += tree_decomposition::estimated_work(td);
+      }
+      return s;
+    }
+  }
+
+  // The subproblems for the edges of g with the given indices, in the
+  // order of edges(g).
+  inline std::vector<subproblem> enumerate(graph_type const& g,
+    std::vector<unsigned int> const& chosen)
+  {
+    return detail::enumerate(num_vertices(g), detail::edge_list(g), chosen);
+  }
+
+  inline graph_type quotient(graph_type const& g, std::vector<unsigned int> const& chosen,
+    subproblem const& s)
+  {
+    return detail::quotient(num_vertices(g), detail::edge_list(g), chosen, s);
+  }
+
+  struct stats {
+    unsigned int width_before, width_after;  // largest over the subproblems
+    double work_before, work_after;          // sum over the subproblems
+    unsigned int pairs;                      // of vertices whose edges were chosen
+  };
+
+  // Chooses the edges between up to the given number of pairs of
+  // vertices, one pair at a time: the candidates are the pairs of
+  // adjacent vertices, at most max_candidates of them, with both ends
+  // in the widest bag of the widest subproblem, then with one end there
+  // (the bag may be made of fill-in edges), and the one giving the smallest
+  // width, then estimated work, of the subproblems is taken (with the
+  // greedy degree order, which is fast), unless it is no better than
+  // the subproblems so far, which ends the choice. All the edges
+  // between a pair are taken together, no more than max_edges in total,
+  // since each doubles the number of sets B. Returns the indices of the
+  // edges, in the order of edges(g).
+  inline std::vector<unsigned int> choose(graph_type const& g, unsigned int pairs,
+    stats* s = nullptr, unsigned int max_candidates = 32, unsigned int max_edges = 16)
+  {
+    unsigned int const n = num_vertices(g);
+    auto const e = detail::edge_list(g);
+    std::map<std::pair<unsigned int, unsigned int>, std::vector<unsigned int> > between;
+    for (unsigned int k = 0; k < e.size(); ++k) {
+      if (e[k].first != e[k].second)
+        between[std::minmax(e[k].first, e[k].second)].push_back(k);
+    }
+
+    std::vector<unsigned int> chosen;
+    unsigned int used = 0;
+    auto current = detail::evaluate(n, e, chosen);
+    if (s) {
+      s->width_before = current.width;
+      s->work_before = current.work;
+    }
+    for (unsigned int round = 0; round < pairs; ++round) {
+      // the widest bag of the widest subproblem, as reduced
+      auto const subproblems = detail::enumerate(n, e, chosen);
+      auto const& widest = subproblems[current.widest];
+      std::vector<unsigned int> kept;
+      auto const td = detail::decompose(detail::quotient(n, e, chosen, widest), &kept);
+      tree_decomposition::bag_ptr largest = td;
+      for (auto const& b : tree_decomposition::flatten(td).bags) {
+        if (b->vertices.size() > largest->vertices.size())
+          largest = b;
+      }
+      std::vector<bool> in_largest(n, false);
+      for (auto i : largest->vertices)
+        in_largest[kept[i]] = true;
+      // the vertex of the quotient of each vertex of g
+      std::vector<unsigned int> label(n);
+      unsigned int count = 0;
+      for (unsigned int v = 0; v < n; ++v)
+        label[v] = widest.root[v] == v ? count++ : label[widest.root[v]];
+
+      bool found = false;
+      detail::score best{0, 0.0, 0};
+      std::vector<unsigned int> best_chosen;
+      unsigned int tried = 0;
+      for (unsigned int ends = 2; ends > 0; --ends) {
+        for (auto const& x : between) {
+          if (tried == max_candidates)
+            break;
+          unsigned int const a = label[x.first.first], b = label[x.first.second];
+          if (a == b or unsigned(in_largest[a] + in_largest[b]) != ends)
+            continue;
+          if (std::find(chosen.begin(), chosen.end(), x.second.front()) != chosen.end())
+            continue;
+          if (chosen.size() + x.second.size() > max_edges)
+            continue;
+          ++ tried;
+          auto candidate = chosen;
+          candidate.insert(candidate.end(), x.second.begin(), x.second.end());
+          auto const score = detail::evaluate(n, e, candidate);
+          if (not found or score < best) {
+            found = true;
+            best = score;
+            best_chosen.swap(candidate);
+          }
+        }
+      }
+      if (not found or not (best < current))
+        break;
+      chosen.swap(best_chosen);
+      current = best;
+      ++ used;
+    }
+    if (s) {
+      s->width_after = current.width;
+      s->work_after = current.work;
+      s->pairs = used;
+    }
+    return chosen;
+  }
+}
+
+#endif
@@ -15,6 +15,8 @@
 #define CONNECTIVITY_HPP
 
 #include "connectivity_functions.hpp"
+#include "utility/arena.hpp"
+#include "utility/binary_io.hpp"
 
 #include <boost/cstdint.hpp>
 #include <boost/functional/hash.hpp>
@@ -29,10 +31,22 @@ class connectivity
   unsigned int size_;
   uint8_t * impl_;
 
+  // buffers come from the current arena, if any
+  static uint8_t* allocate(unsigned int n)
+  {
+    return static_cast<uint8_t*>(memory::allocate(n));
+  }
+
 public:
+  connectivity()
+    : size_(0)
+    , impl_(nullptr)
+  {
+  }
+
   connectivity(unsigned int n)
     : size_(n)
-    , impl_(new uint8_t[size_])
+    , impl_(allocate(size_))
   {
     for (unsigned int i = 0; i < size_; ++i)
       impl_[i] = i + 1;
@@ -40,29 +54,42 @@ public:
 
   connectivity(const connectivity& rhs)
     : size_(rhs.size_)
-    , impl_(new uint8_t[size_])
+    , impl_(allocate(size_))
   {
     std::copy(rhs.impl_, rhs.impl_ + rhs.size_, impl_);
   }
 
+  connectivity(connectivity&& rhs)
+    : size_(rhs.size_)
+    , impl_(rhs.impl_)
+  {
+    rhs.size_ = 0;
+    rhs.impl_ = nullptr;
+  }
+
   ~connectivity()
   {
-    if (impl_)
-      delete [] impl_;
+    memory::deallocate(impl_);
   }
 
   connectivity& operator=(const connectivity& rhs)
   {
     if (this != &rhs) {
-      uint8_t* new_impl_ = new uint8_t[rhs.size_];
+      uint8_t* new_impl_ = allocate(rhs.size_);
       std::copy(rhs.impl_, rhs.impl_ + rhs.size_, new_impl_);
-      delete [] impl_;
+      memory::deallocate(impl_);
       impl_ = new_impl_;
       size_ = rhs.size_;
     }
     return *this;
   }
 
+  connectivity& operator=(connectivity&& rhs)
+  {
+    swap(rhs);
+    return *this;
+  }
+
   unsigned int size() const
   {
     return size_;
@@ -80,6 +107,12 @@ public:
     return (size_ == rhs.size_) and std::equal(impl_, impl_ + size_, rhs.impl_);
   }
 
+  // lexicographic, a total order on canonical connectivities
+  bool operator<(const connectivity& rhs) const
+  {
+    return std::lexicographical_compare(impl_, impl_ + size_, rhs.impl_, rhs.impl_ + rhs.size_);
+  }
+
   connectivity& canonicalize()
   {
     connectivity_functions::canonicalize(size_, impl_);
@@ -127,6 +160,21 @@ public:
     connectivity_functions::decompose(size_, impl_, f);
   }
 
+  friend void write_binary(std::FILE* f, connectivity const& c)
+  {
+    binary_io::write_binary(f, boost::uint32_t(c.size_));
+    binary_io::write_raw(f, c.impl_, c.size_);
+  }
+
+  friend void read_binary(std::FILE* f, connectivity& c)
+  {
+    boost::uint32_t n;
+    binary_io::read_binary(f, n);
+    connectivity tmp(n);
+    binary_io::read_raw(f, tmp.impl_, n);
+    c.swap(tmp);
+  }
+
   friend std::size_t hash_value(const connectivity&);
   friend std::ostream& operator<<(std::ostream&, const connectivity&);
 };
@@ -0,0 +1,513 @@
+/*
+ *  deletion_contraction.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef DELETION_CONTRACTION_HPP
+#define DELETION_CONTRACTION_HPP
+
+#include "utility/arithmetic.hpp"
+
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The partition function by deletion and contraction,
+//
+//   Z(G) = a Z(G - e) + b Z(G / e)
+//
+// for an edge e weighing a when absent and b when present (see
+// preprocess.hpp), with the graphs met along the way cached up to
+// isomorphism. Where the transfer keeps a table of all the partitions
+// of a bag, whose number grows as the Bell numbers, this only ever
+// holds graphs, and dense graphs turn into few of them up to
+// isomorphism: contracting edges of a complete graph gives back a
+// complete graph, with parallel edges merged. It pays on small dense
+// graphs, where the tree decompositions are a single wide bag.
+//
+// Before each branching the graph is reduced: isolated vertices are a
+// factor of Q, a vertex of degree one a factor of Q a + b, vertices of
+// degree two are removed by the series rule, parallel edges are merged
+// as they appear and components are computed separately.
+
+namespace deletion_contraction {
+
+  struct statistics {
+    std::size_t calls;    // graphs branched on or found in the cache
+    std::size_t hits;     // found in the cache
+    std::size_t entries;  // graphs in the cache
+  };
+
+  namespace detail {
+    // A graph with edges merged, as a matrix of edge weights, 0 for no
+    // edge, and no loops.
+    struct multigraph {
+      unsigned int n;
+      std::vector<unsigned int> w;
+
+      explicit multigraph(unsigned int n = 0) : n(n), w(n * n, 0) {}
+
+      unsigned int& at(unsigned int i, unsigned int j) { return w[i * n + j]; }
+      unsigned int at(unsigned int i, unsigned int j) const { return w[i * n + j]; }
+
+      unsigned int degree(unsigned int i) const
+      {
+        unsigned int d = 0;
+        for (unsigned int j = 0; j < n; ++j)
+          d += at(i, j) != 0;
+        return d;
+      }
+
+      // the subgraph on the vertices with keep set, in their order
+      multigraph induced(std::vector<bool> const& keep) const
+      {
+        std::vector<unsigned int> index;
+        for (unsigned int i = 0; i < n; ++i) {
+          if (keep[i])
+            index.push_back(i);
+        }
+        multigraph h(index.size());
+        for (unsigned int i = 0; i < h.n; ++i) {
+          for (unsigned int j = 0; j < h.n; ++j)
+            h.at(i, j) = at(index[i], index[j]);
+        }
+        return h;
+      }
+    };
+
+    struct key_hash {
+      std::size_t operator()(std::vector<unsigned int> const& a) const
+      {
+        std::size_t h = 0;
+        for (auto x : a)
+          h = h * 0x9e3779b97f4a7c15ull + x;
+        return h;
+      }
+    };
+
+    // Canonical form, up to a point: the vertices are ordered by colour
+    // refinement (each vertex is told apart by the colours of its
+    // neighbours and the weights of the edges to them, until nothing
+    // changes) and the ties left are broken by trying each vertex of
+    // the first smallest tied class in turn, refining again, keeping
+    // the smallest matrix found. Highly symmetric graphs give the same
+    // matrix whatever the choice; others could take too many tries,
+    // and past max_leaves the smallest matrix so far is used. The key
+    // still is the graph itself, only not always the same for
+    // isomorphic graphs.
+    class canonical_form {
+      multigraph const& g_;
+      unsigned int max_leaves_;
+      unsigned int leaves_;
+      std::vector<unsigned int> best_;
+
+      // order holds the vertices, cell[i] whether a class starts at i
+      void refine(std::vector<unsigned int>& order, std::vector<bool>& cell) const
+      {
+        unsigned int const n = g_.n;
+        std::vector<unsigned int> colour(n);
+        std::vector<std::vector<unsigned long long> > signature(n);
+        for (bool changed = true; changed; ) {
+          changed = false;
+          unsigned int c = 0;
+          for (unsigned int i = 0; i < n; ++i) {
+            if (cell[i])
+              c = i;
+            colour[order[i]] = c;
+          }
+          for (unsigned int v = 0; v < n; ++v) {
+            auto& s = signature[v];
+            s.clear();
+            for (unsigned int u = 0; u < n; ++u) {
+              if (g_.at(v, u))
+                s.push_back((unsigned long long) colour[u] << 32 | g_.at(v, u));
+            }
+            std::sort(s.begin(), s.end());
+          }
+          for (unsigned int i = 0; i < n; ) {
+            unsigned int j = i + 1;
+            while (j < n and not cell[j])
+              ++ j;
+            auto const first = order.begin() + i, last = order.begin() + j;
+            std::stable_sort(first, last, [&](unsigned int a, unsigned int b) {
+              return signature[a] < signature[b];
+            });
+            for (unsigned int k = i + 1; k < j; ++k) {
+              if (signature[order[k]] != signature[order[k - 1]]) {
+                cell[k] = true;
+                changed = true;
+              }
+            }
+            i = j;
+          }
+        }
+      }
+
+      void search(std::vector<unsigned int> order, std::vector<bool> cell)
+      {
+        refine(order, cell);
+        unsigned int const n = g_.n;
+        unsigned int first = n, size = n + 1;
+        for (unsigned int i = 0; i < n; ) {
+          unsigned int j = i + 1;
+          while (j < n and not cell[j])
+            ++ j;
+          if (j - i > 1 and j - i < size) {
+            first = i;
+            size = j - i;
+          }
+          i = j;
+        }
+
+        if (first == n) {
+          ++ leaves_;
+          std::vector<unsigned int> m;
+          m.reserve(1 + n * (n - 1) / 2);
+          m.push_back(n);
+          for (unsigned int i = 0; i < n; ++i) {
+            for (unsigned int j = i + 1; j < n; ++j)
+              m.push_back(g_.at(order[i], order[j]));
+          }
+          if (best_.empty() or m < best_)
+            best_.swap(m);
+          return;
+        }
+
+        for (unsigned int k = first; k < first + size and leaves_ < max_leaves_; ++k) {
+          auto o = order;
+          auto c = cell;
+          std::swap(o[first], o[k]);
+          c[first + 1] = true;
+          search(std::move(o), std::move(c));
+        }
+      }
+
+    public:
+      canonical_form(multigraph const& g, unsigned int max_leaves)
+        : g_(g), max_leaves_(max_leaves), leaves_(0)
+      {
+        std::vector<unsigned int> order(g.n);
+        for (unsigned int i = 0; i < g.n; ++i)
+          order[i] = i;
+        std::vector<bool> cell(g.n, false);
+        if (g.n > 0)
+          cell[0] = true;
+        search(order, cell);
+      }
+
+      std::vector<unsigned int>& key() { return best_; }
+    };
+  }
+
+  template<class Weight>
+  class engine {
+    typedef detail::multigraph multigraph;
+
+    enum rule { edge, parallel, series };
+    // a weight as the rule that made it and the weights it joins; both
+    // rules are symmetric and associative, so a join of joins by the
+    // same rule is flattened into one join of all their parts, sorted
+    typedef std::pair<rule, std::vector<unsigned int> > term;
+
+    Weight Q_, v_;
+    // edge weights, (absent, present), by number from 1 on, 1 being a
+    // plain edge, with the terms they stand for, so that equal terms
+    // get the same number whatever order they were joined in
+    std::vector<std::pair<Weight, Weight> > weights_;
+    std::vector<term> terms_;
+    std::map<term, unsigned int> ids_;
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> parallel_, series_;
+    std::unordered_map<std::vector<unsigned int>, Weight, detail::key_hash> cache_;
+    std::size_t max_entries_;
+    statistics stats_;
+
+    unsigned int add(Weight const& a, Weight const& b, term t)
+    {
+      weights_.emplace_back(a, b);
+      terms_.push_back(t);
+      return ids_[std::move(t)] = weights_.size() - 1;
+    }
+
+    term join(rule how, unsigned int x, unsigned int y) const
+    {
+      term t(how, std::vector<unsigned int>());
+      for (auto z : {x, y}) {
+        if (terms_[z].first == how)
+          t.second.insert(t.second.end(), terms_[z].second.begin(), terms_[z].second.end());
+        else
+          t.second.push_back(z);
+      }
+      std::sort(t.second.begin(), t.second.end());
+      return t;
+    }
+
+    std::pair<Weight, Weight> const& weight(unsigned int x) const { return weights_[x]; }
+
+    // the rules of preprocess.hpp
+    unsigned int join_parallel(unsigned int x, unsigned int y)
+    {
+      auto k = std::minmax(x, y);
+      auto it = parallel_.find(k);
+      if (it != parallel_.end())
+        return it->second;
+      term t = join(parallel, x, y);
+      auto found = ids_.find(t);
+      if (found != ids_.end())
+        return parallel_[k] = found->second;
+      Weight a, b;
+      addmul(a, weight(x).first, weight(y).first);
+      addmul(b, weight(x).second, weight(y).second);
+      addmul(b, weight(x).first, weight(y).second);
+      addmul(b, weight(x).second, weight(y).first);
+      unsigned int const z = add(a, b, std::move(t));
+      return parallel_[k] = z;
+    }
+
+    unsigned int join_series(unsigned int x, unsigned int y)
+    {
+      auto k = std::minmax(x, y);
+      auto it = series_.find(k);
+      if (it != series_.end())
+        return it->second;
+      term t = join(series, x, y);
+      auto found = ids_.find(t);
+      if (found != ids_.end())
+        return series_[k] = found->second;
+      Weight a, b, both_absent;
+      addmul(both_absent, weight(x).first, weight(y).first);
+      addmul(a, Q_, both_absent);
+      addmul(a, weight(x).second, weight(y).first);
+      addmul(a, weight(x).first, weight(y).second);
+      addmul(b, weight(x).second, weight(y).second);
+      unsigned int const z = add(a, b, std::move(t));
+      return series_[k] = z;
+    }
+
+    void connect(multigraph& g, unsigned int i, unsigned int j, unsigned int x)
+    {
+      unsigned int& slot = g.at(i, j);
+      slot = slot ? join_parallel(slot, x) : x;
+      g.at(j, i) = slot;
+    }
+
+    // removes vertices of degree at most two, multiplying factor by
+    // what they contribute
+    void reduce(multigraph& g, Weight& factor)
+    {
+      for (bool changed = true; changed; ) {
+        changed = false;
+        std::vector<bool> keep(g.n, true);
+        for (unsigned int m = 0; m < g.n; ++m) {
+          unsigned int ends[2], k = 0;
+          for (unsigned int j = 0; j < g.n and k < 3; ++j) {
+            if (g.at(m, j)) {
+              if (k < 2)
+                ends[k] = j;
+              ++ k;
+            }
+          }
+          if (k == 0) {
+            factor *= Q_;
+          } else if (k == 1) {
+            auto const& w = weight(g.at(m, ends[0]));
+            Weight f = w.second;
+            addmul(f, Q_, w.first);
+            factor *= f;
+            g.at(m, ends[0]) = g.at(ends[0], m) = 0;
+          } else if (k == 2) {
+            unsigned int const x = g.at(m, ends[0]), y = g.at(m, ends[1]);
+            g.at(m, ends[0]) = g.at(ends[0], m) = 0;
+            g.at(m, ends[1]) = g.at(ends[1], m) = 0;
+            connect(g, ends[0], ends[1], join_series(x, y));
+          } else {
+            continue;
+          }
+          keep[m] = false;
+          changed = true;
+        }
+        if (changed)
+          g = g.induced(keep);
+      }
+    }
+
+    Weight solve(multigraph g)
+    {
+      Weight factor(1);
+      reduce(g, factor);
+      if (g.n == 0)
+        return factor;
+
+      // components
+      std::vector<unsigned int> component(g.n, g.n), stack;
+      unsigned int count = 0;
+      for (unsigned int r = 0; r < g.n; ++r) {
+        if (component[r] != g.n)
+          continue;
+        component[r] = count;
+        stack.assign(1, r);
+        while (not stack.empty()) {
+          unsigned int const i = stack.back();
+          stack.pop_back();
+          for (unsigned int j = 0; j < g.n; ++j) {
+            if (g.at(i, j) and component[j] == g.n) {
+              component[j] = count;
+              stack.push_back(j);
+            }
+          }
+        }
+        ++ count;
+      }
+      if (count == 1) {
+        factor *= solve_connected(g);
+      } else {
+        for (unsigned int c = 0; c < count; ++c) {
+          std::vector<bool> keep(g.n);
+          for (unsigned int i = 0; i < g.n; ++i)
+            keep[i] = component[i] == c;
+          factor *= solve_connected(g.induced(keep));
+        }
+      }
+      return factor;
+    }
+
+    // g is connected, with minimum degree three
+    Weight solve_connected(multigraph const& g)
+    {
+      ++ stats_.calls;
+      detail::canonical_form form(g, 32);
+      auto& key = form.key();
+      auto it = cache_.find(key);
+      if (it != cache_.end()) {
+        ++ stats_.hits;
+        return it->second;
+      }
+
+      // an edge from a vertex of least degree to its neighbour of
+      // largest degree: deleting it soon leaves the former to the
+      // series rule, contracting it merges many edges
+      unsigned int u = 0;
+      std::vector<unsigned int> degree(g.n);
+      for (unsigned int i = 0; i < g.n; ++i) {
+        degree[i] = g.degree(i);
+        if (degree[i] < degree[u])
+          u = i;
+      }
+      unsigned int x = g.n;
+      for (unsigned int j = 0; j < g.n; ++j) {
+        if (g.at(u, j) and (x == g.n or degree[j] > degree[x]))
+          x = j;
+      }
+      auto const w = weight(g.at(u, x));
+
+      multigraph deleted = g;
+      deleted.at(u, x) = deleted.at(x, u) = 0;
+
+      multigraph contracted = g;
+      contracted.at(u, x) = contracted.at(x, u) = 0;
+      for (unsigned int j = 0; j < g.n; ++j) {
+        if (unsigned int const y = contracted.at(x, j)) {
+          contracted.at(x, j) = contracted.at(j, x) = 0;
+          connect(contracted, u, j, y);
+        }
+      }
+      std::vector<bool> keep(g.n, true);
+      keep[x] = false;
+
+      Weight z;
+      addmul(z, w.first, solve(std::move(deleted)));
+      addmul(z, w.second, solve(contracted.induced(keep)));
+
+      if (cache_.size() < max_entries_) {
+        cache_.emplace(std::move(key), z);
+        ++ stats_.entries;
+      }
+      return z;
+    }
+
+  public:
+    template<class T, class U>
+    engine(T const& Q, U const& v, std::size_t max_entries = 1 << 20)
+      : Q_(Q), v_(v), weights_(1), terms_(1), max_entries_(max_entries), stats_{0, 0, 0}
+    {
+      // 1 is a plain edge
+      add(Weight(1), v_, term(edge, std::vector<unsigned int>()));
+    }
+
+    // Z of g, a graph with plain edges whose vertices have indices in
+    // [0, num_vertices(g))
+    template<class Graph>
+    Weight compute(Graph const& g)
+    {
+      using boost::vertex_index;
+      unsigned int const n = num_vertices(g);
+      multigraph h(n);
+      Weight factor(1);
+      typename boost::graph_traits<Graph>::edge_iterator ei, ei_end;
+      for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+        unsigned int const a = get(vertex_index, g, source(*ei, g));
+        unsigned int const b = get(vertex_index, g, target(*ei, g));
+        if (a == b) {
+          // a loop, absent or present
+          Weight f(1);
+          f += v_;
+          factor *= f;
+        } else {
+          connect(h, a, b, 1);
+        }
+      }
+      factor *= solve(std::move(h));
+      return factor;
+    }
+
+    statistics const& stats() const { return stats_; }
+  };
+
+  // Whether g, a connected graph, is better left to this engine than to
+  // the transfer: the cache pays on graphs that are complete but for a
+  // few pairs of vertices, where contracting gives back few graphs up
+  // to isomorphism, while the transfer blows up on bags as wide as the
+  // graph. The minimum degree is a lower bound on the width; at 11 the
+  // bags hold 12 vertices, Bell(12) = 4213597 partitions. Past n / 6
+  // missing pairs the symmetry is lost and the cache no longer helps
+  // (on random graphs of 12 to 14 vertices the transfer wins from
+  // there on, as it does on sparser symmetric graphs, such as the
+  // complements of cycles).
+  template<class Graph>
+  bool preferable(Graph const& g)
+  {
+    using boost::vertex_index;
+    unsigned int const n = num_vertices(g);
+    if (n < 12)
+      return false;
+    std::vector<std::vector<bool> > adjacent(n, std::vector<bool>(n, false));
+    typename boost::graph_traits<Graph>::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      unsigned int const a = get(vertex_index, g, source(*ei, g));
+      unsigned int const b = get(vertex_index, g, target(*ei, g));
+      if (a != b)
+        adjacent[a][b] = adjacent[b][a] = true;
+    }
+    std::size_t missing = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int const degree = std::count(adjacent[i].begin(), adjacent[i].end(), true);
+      if (degree < 11)
+        return false;
+      missing += n - 1 - degree;
+    }
+    return missing / 2 <= n / 6;
+  }
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ *  estimate.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef ESTIMATE_HPP
+#define ESTIMATE_HPP
+
+#include "profiler.hpp"
+#include "transfer.hpp"
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Predicts, before computing anything, the number of states in the
+// table of each bag, the work of the operators (entries visited by
+// joins and deletions, pairs of entries visited by fusions) and the
+// peak number of live table entries. States are either bounded by the
+// number of partitions of a bag (Bell numbers), or of non-crossing
+// partitions (Catalan numbers, for planar graphs), or counted exactly
+// by running the operators with a weight that carries no information
+// (see utility/unit.hpp).
+
+namespace estimate {
+  using tree_decomposition::bag_ptr;
+
+  enum method { bell, catalan, count };
+
+  inline bool parse_method(std::string const& s, method& m)
+  {
+    if (s == "bell")
+      m = bell;
+    else if (s == "catalan")
+      m = catalan;
+    else if (s == "count")
+      m = count;
+    else
+      return false;
+    return true;
+  }
+
+  inline char const* name(method m)
+  {
+    switch (m) {
+    case bell: return "bell";
+    case catalan: return "catalan";
+    case count: return "count";
+    }
+    return "";
+  }
+
+  struct report {
+    method how;
+    // bags in pre-order
+    tree_decomposition::flat_tree tree;
+    std::vector<double> states;
+    std::vector<double> work;
+    double total_work;
+    double peak;
+  };
+
+  inline report bounds(bag_ptr root, method how)
+  {
+    using namespace tree_decomposition;
+    states_bound const f = how == catalan ? catalan_number : bell_number;
+
+    report r;
+    r.how = how;
+    r.tree = flatten(root);
+    for (auto const& b : r.tree.bags)
+      r.states.push_back(f(b->vertices.size()));
+    r.total_work = estimated_work(root, f, &r.work);
+    r.peak = predicted_peak(root, f);
+    return r;
+  }
+
+  // runs op, which should have weightless::unit weights, recording the
+  // actual size of every table
+  template<class Operators>
+  report count_states(Operators const& op, bag_ptr root, transfer::options opt)
+  {
+    transfer::statistics stats;
+    profiling::profiler profile(root);
+    opt.stats = &stats;
+    opt.profile = &profile;
+    opt.checkpoints = nullptr;
+    transfer::transfer(op, root, opt);
+
+    report r;
+    r.how = count;
+    r.tree = tree_decomposition::flatten(root);
+    r.states.assign(r.tree.bags.size(), 0.0);
+    r.work.assign(r.tree.bags.size(), 0.0);
+    profile.for_each_record(0, [&](unsigned int bag, profiling::operation what,
+        std::size_t in, std::size_t in2, std::size_t out) {
+      r.states[bag] = std::max<double>(r.states[bag], out);
+      if (what == profiling::fusion)
+        r.work[bag] += double(in) * in2;
+      else if (what != profiling::restore)
+        r.work[bag] += in;
+    });
+    r.total_work = 0;
+    for (auto w : r.work)
+      r.total_work += w;
+    r.peak = stats.peak();
+    return r;
+  }
+
+  // a summary, and with per_bag a line for each bag
+  inline void print(std::ostream& o, report const& r, bool per_bag)
+  {
+    if (per_bag) {
+      for (unsigned int i = 0; i < r.tree.bags.size(); ++i) {
+        o << "bag " << i << " parent " << r.tree.parent[i]
+          << " size " << r.tree.bags[i]->vertices.size()
+          << " edges " << r.tree.bags[i]->edges.size()
+          << " states " << r.states[i] << " work " << r.work[i] << "\n";
+      }
+    }
+    double max_states = 0;
+    for (auto s : r.states)
+      max_states = std::max(max_states, s);
+    o << "Estimate (" << name(r.how) << "):\n"
+      << "  bags: " << r.tree.bags.size() << "\n"
+      << "  width: " << max_bag_size(r.tree.bags.front()) - 1 << "\n"
+      << "  largest table: " << max_states << " states\n"
+      << "  total work: " << r.total_work << "\n"
+      << "  peak table entries: " << r.peak << "\n";
+  }
+}
+
+#endif
@@ -0,0 +1,546 @@
+/*
+ *  lattice.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef LATTICE_HPP
+#define LATTICE_HPP
+
+#include "connectivity/connectivity.hpp"
+#include "tree_decomposition/cost_model.hpp"
+#include "tutte.hpp"
+#include "utility/arena.hpp"
+#include "utility/polynomial_two.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Transfer matrix for strips of the square lattice, L vertices wide
+// (free, or periodic across the width: a cylinder) and M long. The
+// states are the connectivities of a bag of L vertices, one in each
+// row, as in a tree decomposition. A column is added one vertex at a
+// time: the vertex of row r of the new column takes the place of that
+// of the old column in the bag (a fusion), is joined to it and to its
+// neighbours in the new column already in the bag, and the old one is
+// deleted. Each of these L steps is a sparse matrix with at most four
+// entries in a row. Its rows are built once, with the operators of
+// tutte in symbolic Q and v, the first time a state shows up; the
+// coefficients, small polynomials of which there are a handful, are
+// evaluated in the weights of the run. Closing the strip after each
+// column (deleting all the vertices) gives the partition function of
+// every length up to M in one sweep.
+//
+// Rows are added from both sides towards the middle (0, L - 1, 1,
+// L - 2, ...), so that after every second step the reflection of the
+// rows maps the bag to itself and commutes with the two steps S that
+// follow. The vector over the states then weighs a state and its mirror
+// image the same, and only the smaller of the two is kept. The orbit of
+// a representative s is made of the g s for g in the cosets G/H of its
+// stabilizer H, and S g s = g S s, so for x the vector over the
+// representatives and x_H its part with stabilizer H,
+//
+//   S x = sum_H sum_{g in G/H} g S x_H.
+//
+// The steps run once for each stabilizer (states equal to their mirror
+// image, and the others), and an entry of S x_H at a state goes to the
+// representative of that state as many times as a coset of G/H takes
+// the state there: integer multiplicities, no division. The vectors
+// kept at the end of a stage are about halved, those in the middle of
+// one less so. (The rotations of a cylinder map a
+// column to itself too, but not the bag halfway through a column.)
+
+namespace lattice {
+
+  struct strip {
+    unsigned int width;
+    bool periodic;  // the first and last row are adjacent
+  };
+
+  // The widest strip: the bag holds L + 1 vertices within a step, and
+  // connectivity_functions takes labels up to the size plus one, in
+  // tables of 50.
+  const unsigned int max_width = 47;
+
+  // An upper bound on the entries of the two vectors kept at once, the
+  // input and output of a step. The bag lies on the outer face of the
+  // part of the strip added so far (a cylinder too is planar), so the
+  // connectivities are non-crossing partitions of its L vertices.
+  inline double predicted_peak(strip const& s)
+  {
+    return 2 * tree_decomposition::catalan_number(s.width);
+  }
+
+  // parses LxM
+  inline bool parse_size(std::string const& s, unsigned int& width, unsigned int& length)
+  {
+    auto it = s.begin();
+    auto number = [&](unsigned int& n) {
+      if (it == s.end() or not std::isdigit(*it))
+        return false;
+      n = 0;
+      while (it != s.end() and std::isdigit(*it))
+        n = 10 * n + (*it++ - '0');
+      return true;
+    };
+    if (not number(width) or it == s.end() or *it++ != 'x' or not number(length))
+      return false;
+    return it == s.end() and width > 0 and length > 0;
+  }
+
+  class transfer_matrix {
+  public:
+    using symbolic = polynomial_two<int>;
+
+  private:
+    using operators = tutte<symbolic>;
+    using table_type = operators::table_type;
+
+    struct entry {
+      unsigned int to;
+      unsigned int coefficient;
+    };
+    using row_type = std::vector<entry>;
+    using mask = boost::uint64_t;  // a set of symmetries
+
+    // row r takes the place of position r, the old vertex going to
+    // position L to be deleted, and is joined to the rows in joined
+    struct step {
+      unsigned int row;
+      std::vector<unsigned int> mapping;
+      std::vector<unsigned int> joined;
+    };
+
+    strip strip_;
+    operators op_;
+    std::vector<step> steps_;
+    std::vector<unsigned int> stages_;  // the steps after which S commutes
+
+    // states, and the number of their blocks
+    std::vector<connectivity> states_;
+    std::vector<unsigned int> blocks_;
+    std::unordered_map<connectivity, unsigned int, boost::hash<connectivity> > index_;
+
+    // distinct coefficients, 1 being the first
+    std::vector<symbolic> coefficients_;
+    std::map<std::vector<int>, unsigned int> known_;
+
+    // the first column, and the rows of each step built so far
+    row_type first_;
+    std::vector<std::vector<row_type> > rows_;
+    std::vector<std::vector<bool> > built_;
+    std::size_t entries_;
+
+    // the symmetries of the bag at the end of a stage as permutations
+    // of the rows, the identity first, and their products
+    std::vector<std::vector<unsigned int> > group_;
+    std::vector<std::vector<unsigned int> > product_;
+
+    // for the states at the end of a stage, the representative of the
+    // orbit and the symmetries taking the state to it
+    std::vector<unsigned int> representative_;
+    std::vector<mask> moves_;
+    std::size_t orbits_, largest_;
+
+    unsigned int state(connectivity const& c)
+    {
+      auto it = index_.find(c);
+      if (it != index_.end())
+        return it->second;
+      unsigned int links = 0;
+      c.decompose([&](unsigned int, unsigned int) { ++ links; });
+      states_.push_back(c);
+      blocks_.push_back(strip_.width - links);
+      index_.emplace(c, states_.size() - 1);
+      return states_.size() - 1;
+    }
+
+    unsigned int coefficient(symbolic const& p)
+    {
+      std::vector<int> key;
+      for (auto const& e : p) {
+        if (e.c != 0) {
+          key.push_back(e.i);
+          key.push_back(e.j);
+          key.push_back(e.c);
+        }
+      }
+      auto it = known_.emplace(std::move(key), coefficients_.size()).first;
+      if (it->second == coefficients_.size())
+        coefficients_.push_back(p);
+      return it->second;
+    }
+
+    row_type entries(table_type const& t)
+    {
+      row_type r;
+      for (auto const& e : t) {
+        unsigned int const c = coefficient(e.second);
+        r.push_back(entry{state(e.first), c});
+      }
+      entries_ += r.size();
+      return r;
+    }
+
+    table_type join(unsigned int i, unsigned int j, table_type const& t) const
+    {
+      return op_.join_operator(i, j, t, std::make_pair(i, j));
+    }
+
+    // the row of step r for state s
+    row_type const& row(unsigned int r, unsigned int s)
+    {
+      if (built_[r].size() <= s) {
+        built_[r].resize(states_.size(), false);
+        rows_[r].resize(states_.size());
+      }
+      if (built_[r][s])
+        return rows_[r][s];
+
+      unsigned int const L = strip_.width;
+      table_type t;
+      {
+        auto& out = t.shard(0);
+        memory::arena::scope scope(out.get_arena());
+        out[states_[s]] = symbolic(1);
+      }
+      step const& p = steps_[r];
+      t = op_.table_fusion(p.mapping, t, op_.empty_state(L + 1));
+      t = join(p.row, L, t);
+      for (auto n : p.joined)
+        t = join(n, p.row, t);
+      t = op_.delete_operator(L, t);
+      row_type x = entries(t);
+      // the new states may have grown the index
+      if (built_[r].size() <= s) {
+        built_[r].resize(states_.size(), false);
+        rows_[r].resize(states_.size());
+      }
+      rows_[r][s].swap(x);
+      built_[r][s] = true;
+      return rows_[r][s];
+    }
+
+    connectivity image(connectivity const& c, std::vector<unsigned int> const& g) const
+    {
+      connectivity x(strip_.width);
+      c.decompose([&](unsigned int i, unsigned int j) { x.connect(g[i], g[j]); });
+      return std::move(x.canonicalize());
+    }
+
+    void orbit(unsigned int s)
+    {
+      unsigned int const none = -1;
+      if (representative_.size() <= s) {
+        representative_.resize(states_.size(), none);
+        moves_.resize(states_.size(), 0);
+      }
+      if (representative_[s] != none)
+        return;
+      std::vector<connectivity> images;
+      for (auto const& g : group_)
+        images.push_back(image(states_[s], g));
+      unsigned int best = 0;
+      for (unsigned int g = 1; g < images.size(); ++g) {
+        if (images[g] < images[best])
+          best = g;
+      }
+      mask m = 0;
+      for (unsigned int g = 0; g < images.size(); ++g) {
+        if (images[g] == images[best])
+          m |= mask(1) << g;
+      }
+      unsigned int const r = state(images[best]);
+      if (representative_.size() <= r) {
+        representative_.resize(states_.size(), none);
+        moves_.resize(states_.size(), 0);
+      }
+      representative_[s] = r;
+      moves_[s] = m;
+      if (r == s)
+        ++ orbits_;
+      else
+        orbit(r);
+    }
+
+    unsigned int representative(unsigned int s)
+    {
+      orbit(s);
+      return representative_[s];
+    }
+
+    // the symmetries taking s to its representative, its stabilizer
+    // for a representative
+    mask moves(unsigned int s)
+    {
+      orbit(s);
+      return moves_[s];
+    }
+
+    static unsigned int count(mask m)
+    {
+      unsigned int n = 0;
+      for (; m; m &= m - 1)
+        ++ n;
+      return n;
+    }
+
+    // one symmetry from each coset gH of the subgroup H
+    mask cosets(mask H) const
+    {
+      mask covered = 0, c = 0;
+      for (unsigned int g = 0; g < group_.size(); ++g) {
+        if (covered >> g & 1)
+          continue;
+        c |= mask(1) << g;
+        for (unsigned int h = 0; h < group_.size(); ++h) {
+          if (H >> h & 1)
+            covered |= mask(1) << product_[g][h];
+        }
+      }
+      return c;
+    }
+
+    // a vector over the states, by its nonzero entries
+    template<class Weight>
+    struct state_vector {
+      std::vector<unsigned int> slot;
+      std::vector<std::pair<unsigned int, Weight> > entries;
+
+      // the entry of s, added if missing
+      Weight* find(unsigned int s, bool& added)
+      {
+        unsigned int const none = -1;
+        if (slot.size() <= s)
+          slot.resize(s + 1, none);
+        added = slot[s] == none;
+        if (added) {
+          slot[s] = entries.size();
+          entries.emplace_back(s, Weight());
+        }
+        return &entries[slot[s]].second;
+      }
+
+      // adds x (times f) to the entry of s
+      void add(unsigned int s, Weight const& x, Weight const* f)
+      {
+        bool added;
+        Weight& w = *find(s, added);
+        if (f)
+          addmul(w, x, *f);
+        else
+          w += x;
+      }
+
+      void add(unsigned int s, Weight&& x)
+      {
+        bool added;
+        Weight& w = *find(s, added);
+        if (added)
+          w = std::move(x);
+        else
+          w += x;
+      }
+    };
+
+    template<class Weight>
+    static Weight evaluate(symbolic const& p, Weight const& Q, Weight const& v)
+    {
+      Weight r;
+      for (auto const& e : p) {
+        Weight x(e.c);
+        for (unsigned int k = 0; k < e.i; ++k)
+          x *= Q;
+        for (unsigned int k = 0; k < e.j; ++k)
+          x *= v;
+        r += x;
+      }
+      return r;
+    }
+
+    template<class Weight>
+    void evaluate_new(std::vector<Weight>& c, Weight const& Q, Weight const& v) const
+    {
+      for (std::size_t k = c.size(); k < coefficients_.size(); ++k)
+        c.push_back(evaluate(coefficients_[k], Q, v));
+    }
+
+    // S x, through steps first to last, on the representatives
+    template<class Weight>
+    state_vector<Weight> stage(state_vector<Weight>&& x, unsigned int first,
+      unsigned int last, std::vector<Weight>& c, Weight const& Q, Weight const& v,
+      std::vector<Weight> const& multiple)
+    {
+      std::map<mask, state_vector<Weight> > parts;
+      if (group_.size() == 1) {
+        parts[1] = std::move(x);
+      } else {
+        for (auto& e : x.entries)
+          parts[moves(e.first)].add(e.first, std::move(e.second));
+        x = state_vector<Weight>();
+      }
+      state_vector<Weight> y;
+      for (auto& p : parts) {
+        state_vector<Weight> Sx = std::move(p.second);
+        for (unsigned int r = first; r < last; ++r) {
+          state_vector<Weight> z;
+          for (auto const& e : Sx.entries) {
+            row_type const& to = row(r, e.first);
+            evaluate_new(c, Q, v);
+            for (auto const& t : to)
+              z.add(t.to, e.second, t.coefficient == 0 ? nullptr : &c[t.coefficient]);
+          }
+          std::swap(Sx, z);
+        }
+        if (group_.size() == 1) {
+          y = std::move(Sx);
+          break;
+        }
+        mask const g = cosets(p.first);
+        for (auto& e : Sx.entries) {
+          unsigned int const k = count(moves(e.first) & g);
+          if (k == 1)
+            y.add(representative(e.first), std::move(e.second));
+          else if (k > 1)
+            y.add(representative(e.first), e.second, &multiple[k]);
+        }
+      }
+      largest_ = std::max(largest_, y.entries.size());
+      return y;
+    }
+
+  public:
+    // with symmetry, one state of each pair of mirror images is kept
+    explicit transfer_matrix(strip const& s, bool symmetry = true)
+      : strip_(s), op_(symbolic::Q(), symbolic::v()), coefficients_(1, symbolic(1))
+      , rows_(s.width), built_(s.width), entries_(0), orbits_(0), largest_(0)
+    {
+      unsigned int const L = s.width;
+      known_[std::vector<int>{0, 0, 1}] = 0;
+
+      std::vector<unsigned int> identity(L);
+      for (unsigned int i = 0; i < L; ++i)
+        identity[i] = i;
+      std::vector<bool> added(L, false);
+      for (unsigned int i = 0; i < L; ++i) {
+        step x;
+        x.row = i % 2 == 0 ? i / 2 : L - 1 - i / 2;
+        x.mapping = identity;
+        x.mapping[x.row] = L;
+        unsigned int const below = x.row > 0 ? x.row - 1 : L - 1;
+        unsigned int const above = x.row + 1 < L ? x.row + 1 : 0;
+        if (added[below] and (x.row > 0 or s.periodic))
+          x.joined.push_back(below);
+        if (added[above] and (x.row + 1 < L or s.periodic))
+          x.joined.push_back(above);
+        added[x.row] = true;
+        steps_.push_back(std::move(x));
+        if (i % 2 == 1 or i + 1 == L)
+          stages_.push_back(i + 1);
+      }
+
+      group_.push_back(identity);
+      if (symmetry and L > 1) {
+        std::vector<unsigned int> g(L);
+        for (unsigned int i = 0; i < L; ++i)
+          g[i] = L - 1 - i;
+        group_.push_back(g);
+      }
+      std::map<std::vector<unsigned int>, unsigned int> element;
+      for (unsigned int a = 0; a < group_.size(); ++a)
+        element[group_[a]] = a;
+      product_.assign(group_.size(), std::vector<unsigned int>(group_.size()));
+      for (unsigned int a = 0; a < group_.size(); ++a) {
+        for (unsigned int b = 0; b < group_.size(); ++b) {
+          std::vector<unsigned int> g(L);
+          for (unsigned int i = 0; i < L; ++i)
+            g[i] = group_[a][group_[b][i]];
+          product_[a][b] = element.at(g);
+        }
+      }
+
+      table_type t = op_.empty_state(s.width);
+      for (unsigned int i = 0; i + 1 < s.width; ++i)
+        t = join(i, i + 1, t);
+      if (s.periodic)
+        t = join(s.width - 1, 0, t);
+      first_ = entries(t);
+    }
+
+    std::size_t num_states() const { return states_.size(); }
+
+    // entries of the rows built so far, over all the steps
+    std::size_t num_entries() const { return entries_; }
+
+    std::size_t num_coefficients() const { return coefficients_.size(); }
+
+    std::size_t num_symmetries() const { return group_.size(); }
+
+    // orbits of the states met at the end of a stage
+    std::size_t num_orbits() const { return orbits_; }
+
+    // the most entries kept at the end of a stage
+    std::size_t largest_vector() const { return largest_; }
+
+    // the partition functions of the strips of length 1 to length
+    template<class Weight>
+    std::vector<Weight> partition_functions(Weight const& Q, Weight const& v,
+      unsigned int length)
+    {
+      std::vector<Weight> c;
+      evaluate_new(c, Q, v);
+      std::vector<Weight> power(1, Weight(1)), multiple;
+      for (unsigned int k = 0; k < strip_.width; ++k)
+        power.push_back(power.back() * Q);
+      for (unsigned int k = 0; k <= group_.size(); ++k)
+        multiple.push_back(Weight(k));
+
+      state_vector<Weight> x;
+      for (auto const& e : first_) {
+        if (representative(e.to) == e.to)
+          x.add(e.to, c[e.coefficient], nullptr);
+      }
+
+      std::vector<Weight> z;
+      for (unsigned int m = 0; m < length; ++m) {
+        if (m > 0) {
+          unsigned int first = 0;
+          for (auto last : stages_) {
+            x = stage(std::move(x), first, last, c, Q, v, multiple);
+            first = last;
+          }
+        }
+        largest_ = std::max(largest_, x.entries.size());
+        // each representative stands for its orbit
+        Weight result;
+        for (auto const& e : x.entries) {
+          unsigned int const n = group_.size() / count(moves(e.first));
+          if (n == 1) {
+            addmul(result, e.second, power[blocks_[e.first]]);
+          } else {
+            Weight w = e.second * multiple[n];
+            addmul(result, w, power[blocks_[e.first]]);
+          }
+        }
+        z.push_back(std::move(result));
+      }
+      return z;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ *  preprocess.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef PREPROCESS_HPP
+#define PREPROCESS_HPP
+
+#include "graph_type.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Reductions of the graph before the transfer. In
+//
+//   Z = sum_A Q^k(A) prod_{e in A} v_e
+//
+// an edge may as well weigh a in the sums where it is absent and b in
+// those where it is present, a plain edge having a = 1 and b = v. Then
+//
+//  - two parallel edges are one with a = a1 a2 and b = b1 b2 + a1 b2
+//    + b1 a2 (for k plain edges, a = 1 and b = (1 + v)^k - 1);
+//
+//  - two edges u-m and m-w, where m has no other edges, are one edge
+//    u-w with a = Q a1 a2 + b1 a2 + a1 b2 and b = b1 b2 (m is a
+//    component of its own when both are absent, u and w are connected
+//    through m when both are present).
+//
+// Neither takes a subtraction or a division, so the weights can be
+// computed in any of the weight types of tutte, from Q and v.
+
+namespace preprocess {
+
+  // The weights of the edges of a reduced graph, as terms built from
+  // plain edges by the two rules above, evaluated by tutte in its own
+  // weight type.
+  class edge_weights {
+  public:
+    enum kind { edge, parallel, series };
+
+    struct term {
+      kind how;
+      unsigned int first, second;  // terms combined, earlier ones
+    };
+
+    static const unsigned int plain = 0;
+
+  private:
+    std::vector<term> terms_;
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> edges_;
+
+    unsigned int add(kind how, unsigned int x, unsigned int y)
+    {
+      terms_.push_back(term{how, x, y});
+      return terms_.size() - 1;
+    }
+
+  public:
+    edge_weights() : terms_(1, term{edge, 0, 0}) {}
+
+    unsigned int join_parallel(unsigned int x, unsigned int y) { return add(parallel, x, y); }
+    unsigned int join_series(unsigned int x, unsigned int y) { return add(series, x, y); }
+
+    // the edge a-b of the reduced graph weighs term x
+    void assign(unsigned int a, unsigned int b, unsigned int x)
+    {
+      if (x != plain)
+        edges_[std::minmax(a, b)] = x;
+    }
+
+    // the term of the edge a-b, plain if it was not reduced
+    unsigned int find(unsigned int a, unsigned int b) const
+    {
+      auto it = edges_.find(std::minmax(a, b));
+      return it == edges_.end() ? plain : it->second;
+    }
+
+    // no edge other than plain ones
+    bool empty() const { return edges_.empty(); }
+
+    std::size_t size() const { return edges_.size(); }
+
+    // (absent, present) weights of each term
+    template<class Weight>
+    std::vector<std::pair<Weight, Weight> > evaluate(Weight const& Q, Weight const& v) const
+    {
+      std::vector<std::pair<Weight, Weight> > w;
+      w.reserve(terms_.size());
+      for (auto const& t : terms_) {
+        Weight a, b;
+        if (t.how == edge) {
+          a = Weight(1);
+          b = v;
+        } else {
+          auto const& x = w[t.first];
+          auto const& y = w[t.second];
+          if (t.how == parallel) {
+            addmul(a, x.first, y.first);
+            addmul(b, x.second, y.second);
+            addmul(b, x.first, y.second);
+            addmul(b, x.second, y.first);
+          } else {
+            Weight both_absent;
+            addmul(both_absent, x.first, y.first);
+            addmul(a, Q, both_absent);
+            addmul(a, x.second, y.first);
+            addmul(a, x.first, y.second);
+            addmul(b, x.second, y.second);
+          }
+        }
+        w.emplace_back(std::move(a), std::move(b));
+      }
+      return w;
+    }
+
+    // numbers the terms so that those built in the same way from plain
+    // edges, which weigh the same, get the same number (0 for a plain
+    // edge)
+    std::vector<unsigned int> classes() const
+    {
+      std::map<std::pair<unsigned int, std::pair<unsigned int, unsigned int> >,
+        unsigned int> seen;
+      std::vector<unsigned int> c;
+      c.reserve(terms_.size());
+      for (auto const& t : terms_) {
+        std::pair<unsigned int, unsigned int> parts(0, 0);
+        if (t.how != edge) {
+          // both rules are symmetric
+          parts.first = std::min(c[t.first], c[t.second]);
+          parts.second = std::max(c[t.first], c[t.second]);
+        }
+        auto const key = std::make_pair(unsigned(t.how), parts);
+        c.push_back(seen.emplace(key, seen.size()).first->second);
+      }
+      return c;
+    }
+
+    // FNV-1a of the terms and of the edges they weigh, to tell apart
+    // checkpoints of differently weighted graphs
+    boost::uint64_t digest() const
+    {
+      boost::uint64_t h = 14695981039346656037ull;
+      auto add = [&](unsigned int x) {
+        for (unsigned int k = 0; k < 4; ++k) {
+          h ^= (x >> (8 * k)) & 0xff;
+          h *= 1099511628211ull;
+        }
+      };
+      for (auto const& t : terms_) {
+        add(t.how);
+        add(t.first);
+        add(t.second);
+      }
+      for (auto const& e : edges_) {
+        add(e.first.first);
+        add(e.first.second);
+        add(e.second);
+      }
+      return h;
+    }
+  };
+
+  struct stats {
+    std::size_t vertices_before, edges_before;
+    std::size_t vertices_after, edges_after;
+    std::size_t parallel;  // edges merged into a parallel one
+    std::size_t series;    // vertices of degree two removed
+  };
+
+  // Merges parallel edges (loops included) and, if series is set,
+  // removes the vertices with exactly two neighbours and no loop, until
+  // there are none left. Merging parallel edges saves joins for sure;
+  // removing a vertex in series saves joins and a deletion too, but the
+  // merged edge weighs a polynomial in Q and v, which makes every
+  // operator after its join heavier, and runs can take longer. The
+  // vertices left keep their relative order, and if kept is given it is
+  // set to the vertex of g of each. The treewidth does not grow, the
+  // reduced graph being a minor of g.
+  inline graph_type reduce(graph_type const& g, edge_weights& w, bool series = false,
+    stats* s = nullptr, std::vector<unsigned int>* kept = nullptr)
+  {
+    using boost::vertex_index;
+    unsigned int const n = num_vertices(g);
+    unsigned int const none = -1;
+
+    std::size_t merged = 0, removed = 0;
+    std::vector<std::map<unsigned int, unsigned int> > adjacent(n);
+    std::vector<unsigned int> loop(n, none);
+
+    // x goes in parallel with whatever there is at slot
+    auto merge = [&](unsigned int& slot, unsigned int x) {
+      if (slot == none) {
+        slot = x;
+      } else {
+        slot = w.join_parallel(slot, x);
+        ++ merged;
+      }
+    };
+    auto connect = [&](unsigned int a, unsigned int b, unsigned int x) {
+      auto it = adjacent[a].find(b);
+      unsigned int slot = it == adjacent[a].end() ? none : it->second;
+      merge(slot, x);
+      adjacent[a][b] = adjacent[b][a] = slot;
+    };
+
+    graph_type::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      unsigned int const a = get(vertex_index, g, source(*ei, g));
+      unsigned int const b = get(vertex_index, g, target(*ei, g));
+      if (a == b)
+        merge(loop[a], edge_weights::plain);
+      else
+        connect(a, b, edge_weights::plain);
+    }
+
+    auto in_series = [&](unsigned int m) {
+      return series and adjacent[m].size() == 2 and loop[m] == none;
+    };
+    std::vector<unsigned int> pending;
+    for (unsigned int m = 0; m < n; ++m) {
+      if (in_series(m))
+        pending.push_back(m);
+    }
+    std::vector<bool> gone(n, false);
+    while (not pending.empty()) {
+      unsigned int const m = pending.back();
+      pending.pop_back();
+      if (gone[m] or not in_series(m))
+        continue;
+      auto const first = *adjacent[m].begin();
+      auto const second = *adjacent[m].rbegin();
+      unsigned int const a = first.first, b = second.first;
+      adjacent[a].erase(m);
+      adjacent[b].erase(m);
+      adjacent[m].clear();
+      gone[m] = true;
+      ++ removed;
+      connect(a, b, w.join_series(first.second, second.second));
+      if (in_series(a))
+        pending.push_back(a);
+      if (in_series(b))
+        pending.push_back(b);
+    }
+
+    std::vector<unsigned int> label(n, none);
+    unsigned int k = 0;
+    for (unsigned int v = 0; v < n; ++v) {
+      if (not gone[v])
+        label[v] = k++;
+    }
+    if (kept) {
+      kept->clear();
+      for (unsigned int v = 0; v < n; ++v) {
+        if (not gone[v])
+          kept->push_back(v);
+      }
+    }
+
+    std::vector<std::pair<unsigned int, unsigned int> > edge_list;
+    std::vector<unsigned int> weight;
+    for (unsigned int a = 0; a < n; ++a) {
+      if (gone[a])
+        continue;
+      if (loop[a] != none) {
+        edge_list.emplace_back(label[a], label[a]);
+        weight.push_back(loop[a]);
+      }
+      for (auto const& x : adjacent[a]) {
+        if (a < x.first) {
+          edge_list.emplace_back(label[a], label[x.first]);
+          weight.push_back(x.second);
+        }
+      }
+    }
+    for (std::size_t i = 0; i < edge_list.size(); ++i)
+      w.assign(edge_list[i].first, edge_list[i].second, weight[i]);
+
+    boost::counting_iterator<int> ep_iter(0);
+    graph_type r(edge_list.begin(), edge_list.end(), ep_iter, k);
+    unsigned int i = 0;
+    graph_type::vertex_iterator vi, vi_end;
+    for (boost::tie(vi, vi_end) = vertices(r); vi != vi_end; ++vi)
+      put(vertex_index, r, *vi, i++);
+
+    if (s) {
+      s->vertices_before = n;
+      s->edges_before = num_edges(g);
+      s->vertices_after = k;
+      s->edges_after = edge_list.size();
+      s->parallel = merged;
+      s->series = removed;
+    }
+    return r;
+  }
+}
+
+#endif
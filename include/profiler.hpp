@@ -0,0 +1,236 @@
+/*
+ *  profiler.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Records every table operator run by transfer: which bag, table sizes
+// in and out, wall time, bytes held by the output table and the peak
+// resident set size so far. Operations are grouped in passes, one per
+// call to transfer (hence one per prime with the chinese remainder
+// trick). The whole lot is written as JSON.
+
+namespace profiling {
+  using tree_decomposition::bag_ptr;
+
+  enum operation { join, deletion, fusion, restore };
+
+  inline char const* name(operation op)
+  {
+    switch (op) {
+    case join: return "join";
+    case deletion: return "delete";
+    case fusion: return "fusion";
+    case restore: return "restore";
+    }
+    return "";
+  }
+
+  // in kilobytes, as reported by getrusage on Linux
+  inline long peak_rss()
+  {
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_maxrss;
+  }
+
+  inline std::string quote(std::string const& s)
+  {
+    std::string r = "\"";
+    for (char c : s) {
+      if (c == '"' or c == '\\') {
+        r += '\\';
+        r += c;
+      } else if ((unsigned char) c < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        r += buf;
+      } else {
+        r += c;
+      }
+    }
+    return r + "\"";
+  }
+
+  typedef std::chrono::steady_clock clock;
+
+  inline double seconds_since(clock::time_point t)
+  {
+    return std::chrono::duration<double>(clock::now() - t).count();
+  }
+
+  class profiler {
+    struct record {
+      unsigned int bag;
+      operation op;
+      std::size_t in, in2, out;
+      double seconds;
+      std::size_t bytes;
+      long rss;
+    };
+
+    struct pass {
+      std::string label;
+      double seconds;
+      long rss;
+      std::vector<record> records;
+    };
+
+    tree_decomposition::flat_tree tree_;
+    std::map<tree_decomposition::bag const*, unsigned int> ids_;
+    std::vector<std::pair<std::string, std::string> > info_;
+    std::vector<pass> passes_;
+    clock::time_point start_;
+    std::mutex m_;
+
+  public:
+    // bags are numbered in pre-order, the decomposition must not change
+    // afterwards
+    explicit profiler(bag_ptr root)
+      : tree_(tree_decomposition::flatten(root))
+    {
+      for (unsigned int i = 0; i < tree_.bags.size(); ++i)
+        ids_[tree_.bags[i].get()] = i;
+    }
+
+    // adds a top level field, value must be valid JSON
+    void info(std::string const& key, std::string const& value)
+    {
+      info_.emplace_back(key, value);
+    }
+
+    template<class T>
+    void info_value(std::string const& key, T const& value)
+    {
+      std::ostringstream o;
+      o << value;
+      info(key, o.str());
+    }
+
+    void begin_pass(std::string const& label)
+    {
+      passes_.push_back(pass{label, 0, 0, {}});
+      start_ = clock::now();
+    }
+
+    void end_pass()
+    {
+      passes_.back().seconds = seconds_since(start_);
+      passes_.back().rss = peak_rss();
+    }
+
+    // thread safe
+    void add(bag_ptr b, operation op, std::size_t in, std::size_t in2,
+      std::size_t out, double seconds, std::size_t bytes)
+    {
+      long const rss = peak_rss();
+      std::lock_guard<std::mutex> lock(m_);
+      passes_.back().records.push_back(
+        record{ids_.at(b.get()), op, in, in2, out, seconds, bytes, rss});
+    }
+
+    // calls f(bag, op, in, in2, out) for each operator of the given pass
+    template<class F>
+    void for_each_record(unsigned int pass, F f) const
+    {
+      for (auto const& r : passes_.at(pass).records)
+        f(r.bag, r.op, r.in, r.in2, r.out);
+    }
+
+    void write(std::ostream& o) const
+    {
+      o << "{\n";
+      for (auto const& x : info_)
+        o << "  " << quote(x.first) << ": " << x.second << ",\n";
+
+      o << "  \"bags\": [\n";
+      for (unsigned int i = 0; i < tree_.bags.size(); ++i) {
+        auto const& b = tree_.bags[i];
+        o << "    {\"id\": " << i << ", \"parent\": " << tree_.parent[i]
+          << ", \"vertices\": [";
+        bool first = true;
+        for (auto v : b->vertices) {
+          o << (first ? "" : ", ") << v;
+          first = false;
+        }
+        o << "], \"edges\": " << b->edges.size()
+          << ", \"children\": " << b->children.size() << "}"
+          << (i + 1 < tree_.bags.size() ? ",\n" : "\n");
+      }
+      o << "  ],\n";
+
+      o << "  \"passes\": [\n";
+      for (unsigned int k = 0; k < passes_.size(); ++k) {
+        auto const& p = passes_[k];
+        o << "    {\n"
+          << "      \"label\": " << quote(p.label) << ",\n"
+          << "      \"seconds\": " << p.seconds << ",\n"
+          << "      \"peak_rss_kb\": " << p.rss << ",\n";
+
+        // totals per operation and per bag
+        std::map<std::string, std::pair<std::size_t, double> > per_op;
+        std::map<unsigned int, double> per_bag;
+        for (auto const& r : p.records) {
+          auto& t = per_op[name(r.op)];
+          t.first += 1;
+          t.second += r.seconds;
+          per_bag[r.bag] += r.seconds;
+        }
+        o << "      \"totals\": {";
+        bool first = true;
+        for (auto const& t : per_op) {
+          o << (first ? "" : ", ") << quote(t.first) << ": {\"count\": "
+            << t.second.first << ", \"seconds\": " << t.second.second << "}";
+          first = false;
+        }
+        o << "},\n";
+        o << "      \"bag_seconds\": {";
+        first = true;
+        for (auto const& t : per_bag) {
+          o << (first ? "" : ", ") << "\"" << t.first << "\": " << t.second;
+          first = false;
+        }
+        o << "},\n";
+
+        o << "      \"operations\": [\n";
+        for (unsigned int i = 0; i < p.records.size(); ++i) {
+          auto const& r = p.records[i];
+          o << "        {\"bag\": " << r.bag << ", \"op\": \"" << name(r.op)
+            << "\", \"in\": " << r.in << ", \"in2\": " << r.in2
+            << ", \"out\": " << r.out << ", \"seconds\": " << r.seconds
+            << ", \"bytes\": " << r.bytes << ", \"peak_rss_kb\": " << r.rss << "}"
+            << (i + 1 < p.records.size() ? ",\n" : "\n");
+        }
+        o << "      ]\n"
+          << "    }" << (k + 1 < passes_.size() ? ",\n" : "\n");
+      }
+      o << "  ]\n}\n";
+    }
+  };
+}
+
+#endif
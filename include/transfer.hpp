@@ -14,73 +14,557 @@
 #ifndef TRANSFER_HPP
 #define TRANSFER_HPP
 
+#include "checkpoint.hpp"
+#include "profiler.hpp"
 #include "tree_decomposition/tree_decomposition.hpp"
+#include "utility/thread_pool.hpp"
 #include <boost/range/algorithm/set_algorithm.hpp>
 
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 namespace transfer {
   using tree_decomposition::vertex_list;
   using tree_decomposition::bag_ptr;
 
+  // number of live table entries, and its high-water mark
+  class statistics {
+    std::atomic<std::size_t> live_, peak_;
+    std::atomic<std::size_t> reused_;
+
+  public:
+    statistics() : live_(0), peak_(0), reused_(0) {}
+
+    void add(std::size_t n)
+    {
+      std::size_t const live = live_ += n;
+      std::size_t peak = peak_;
+      while (live > peak and not peak_.compare_exchange_weak(peak, live))
+        ;
+    }
+
+    void remove(std::size_t n) { live_ -= n; }
+
+    std::size_t peak() const { return peak_; }
+
+    // subtrees not computed, their projected table being that of an
+    // isomorphic one
+    void reuse() { ++ reused_; }
+    std::size_t reused() const { return reused_; }
+  };
+
+  struct options {
+    // if set, sibling subtrees are processed in parallel on this pool
+    parallel::thread_pool* pool;
+    // if set, collects the number of live table entries
+    statistics* stats;
+    // if set, projected tables of completed subtrees are saved here and
+    // reloaded instead of being computed again
+    checkpoint::store const* checkpoints;
+    // if set, every operator is recorded here
+    profiling::profiler* profile;
+    // if set, subtrees isomorphic to one already computed are not
+    // computed again (see plan_reuse); not with checkpoints
+    bool reuse;
+
+    options()
+      : pool(nullptr), stats(nullptr), checkpoints(nullptr), profile(nullptr)
+      , reuse(false) {}
+  };
+
+  // runs an operator on behalf of bag b, f returns its output table
+  template<class F>
+  auto timed(options const& opt, bag_ptr b, profiling::operation what,
+    std::size_t in, std::size_t in2, F f) -> decltype(f())
+  {
+    if (not opt.profile)
+      return f();
+    auto const start = profiling::clock::now();
+    auto t = f();
+    opt.profile->add(b, what, in, in2, t.size(), profiling::seconds_since(start), t.bytes());
+    return t;
+  }
+
+  // replaces table with the output of an operator, the input stays
+  // alive until the output is complete
+  template<class Table>
+  void replace(Table& table, Table&& x, options const& opt)
+  {
+    if (opt.stats) {
+      opt.stats->add(x.size());
+      opt.stats->remove(table.size());
+    }
+    table = std::move(x);
+  }
+
+  template<class Operators>
+  typename Operators::table_type
+  empty_state(const Operators& op, bag_ptr b, options const& opt)
+  {
+    if (opt.stats)
+      opt.stats->add(1);
+    return op.empty_state(b->vertices.size());
+  }
+
+  // apply the join operator for each edge in the bag
+  template<class Operators>
+  void join_edges(const Operators& op, bag_ptr b,
+    typename Operators::table_type& table, options const& opt)
+  {
+    for (auto e : b->edges) {
+      replace(table, timed(opt, b, profiling::join, table.size(), 0, [&] {
+            return op.join_operator(b->vertices.index(e.first),
+              b->vertices.index(e.second), table, e);
+          }), opt);
+    }
+  }
+
+  // maps the indices of the vertices of b_sib which are also in b, its
+  // parent, to their indices in b
+  inline void project_mapping(bag_ptr b_sib, bag_ptr b, std::vector<unsigned int>& A_to_B)
+  {
+    A_to_B.clear();
+    for (auto v : b_sib->vertices) {
+      if (b->vertices.has(v))
+        A_to_B.push_back(b->vertices.index(v));
+    }
+  }
+
+  // deletes from the table of b_sib the vertices which are not in its
+  // parent bag b, and fills A_to_B with the mapping from the remaining
+  // indices to the indices of b. The result is saved as a checkpoint, if
+  // enabled.
   template<class Operators>
   typename Operators::table_type
-  recurse(const Operators& op, bag_ptr b)
+  project(const Operators& op, bag_ptr b_sib, bag_ptr b,
+    typename Operators::table_type table_sib,
+    std::vector<unsigned int>& A_to_B, options const& opt)
+  {
+    // diffe contains the vertices in b_sib which are not in b (the parent bag)
+    std::vector<unsigned int> diffe;
+    boost::set_difference(b_sib->vertices, b->vertices, std::back_inserter(diffe));
+
+    // delete each vertex not present in the parent bag
+
+    // we need to make a copy first because
+    // 1) we need to keep the indices consistent while removing vertices
+    // 2) we don't want to destroy the tree decomposition
+    vertex_list b_sib_left_over(b_sib->vertices);
+    for (auto v : diffe) {
+      replace(table_sib, timed(opt, b_sib, profiling::deletion, table_sib.size(), 0, [&] {
+            return op.delete_operator(b_sib_left_over.index(v), table_sib);
+          }), opt);
+      b_sib_left_over.remove(v);
+    }
+
+    // create b_sib to b bag mapping
+    project_mapping(b_sib, b, A_to_B);
+    if (opt.checkpoints)
+      opt.checkpoints->save(b_sib, op.signature(), table_sib);
+    return table_sib;
+  }
+
+  // loads the projected table of b_sib from a checkpoint, if any
+  template<class Operators>
+  bool restore(const Operators& op, bag_ptr b_sib, bag_ptr b,
+    typename Operators::table_type& table_sib,
+    std::vector<unsigned int>& A_to_B, options const& opt)
+  {
+    auto const signature = op.signature();
+    if (not opt.checkpoints or not opt.checkpoints->exists(b_sib, signature))
+      return false;
+    bool found = false;
+    table_sib = timed(opt, b_sib, profiling::restore, 0, 0, [&] {
+        typename Operators::table_type t;
+        found = opt.checkpoints->load(b_sib, signature, t);
+        return t;
+      });
+    if (not found)
+      return false;
+    if (opt.stats)
+      opt.stats->add(table_sib.size());
+    project_mapping(b_sib, b, A_to_B);
+    return true;
+  }
+
+  // fuses the projected table of a child into the table of its parent b
+  template<class Operators>
+  void fuse(const Operators& op, bag_ptr b, std::vector<unsigned int> const& A_to_B,
+    typename Operators::table_type&& table_sib,
+    typename Operators::table_type& table, options const& opt)
   {
-    // create a new table containing only the empty state
-    auto const n = b->vertices.size();
-    auto table = op.empty_state(n);
-
-    // iterates over children
-    for (auto b_sib : b->children) {
-      // recurse
-      auto table_sib = recurse(op, b_sib);
-
-      // diffe contains the vertices in b_sib which are not in b (the parent bag)
-      std::vector<unsigned int> diffe;
-      boost::set_difference(b_sib->vertices, b->vertices, std::back_inserter(diffe));
-
-      // delete each vertex not present in the parent bag
-
-      // we need to make a copy first because
-      // 1) we need to keep the indices consistent while removing vertices
-      // 2) we don't want to destroy the tree decomposition
-      vertex_list b_sib_left_over(b_sib->vertices);
-      for (auto v : diffe) {
-        table_sib = op.delete_operator(b_sib_left_over.index(v), table_sib);
-        b_sib_left_over.remove(v);
+    replace(table, timed(opt, b, profiling::fusion, table_sib.size(), table.size(), [&] {
+          return op.table_fusion(A_to_B, table_sib, table);
+        }), opt);
+    if (opt.stats)
+      opt.stats->remove(table_sib.size());
+  }
+
+  // a projected table fused into more than one bag, which leaves the
+  // statistics when the last of them is done with it
+  template<class Table>
+  std::shared_ptr<Table const> share(Table&& t, options const& opt)
+  {
+    statistics* const stats = opt.stats;
+    return std::shared_ptr<Table const>(new Table(std::move(t)), [stats](Table const* p) {
+        if (stats)
+          stats->remove(p->size());
+        delete p;
+      });
+  }
+
+  template<class Operators>
+  void fuse_shared(const Operators& op, bag_ptr b, std::vector<unsigned int> const& A_to_B,
+    typename Operators::table_type const& table_sib,
+    typename Operators::table_type& table, options const& opt)
+  {
+    replace(table, timed(opt, b, profiling::fusion, table_sib.size(), table.size(), [&] {
+          return op.table_fusion(A_to_B, table_sib, table);
+        }), opt);
+  }
+
+  // Subtrees whose projected tables are the same. The operators only
+  // see positions in the bags, so the table of a bag is a function of
+  // its size, of the positions of the ends of its edges and the classes
+  // of their weights (op.edge_class), and of the projected tables of
+  // its children with the positions they go to. Numbering these shapes
+  // bottom up, and the shapes of projections by the shape of the bag
+  // and the positions kept, subtrees with the same projection shape
+  // give the same table, on positions in the same order, which fuses
+  // into any parent with the mapping of the subtree itself. On periodic
+  // lattices translates of a subtree often are such. The first of each
+  // shape in pre-order (the owner) is computed, the others (followers)
+  // are not visited; an owner is never within a follower, and is done
+  // before its followers are reached by the serial traversal.
+  struct reuse_plan {
+    std::unordered_map<bag_ptr::element_type const*, bag_ptr::element_type const*> owner;
+    std::unordered_map<bag_ptr::element_type const*, unsigned int> followers;
+  };
+
+  template<class Operators>
+  reuse_plan plan_reuse(const Operators& op, bag_ptr root)
+  {
+    auto const t = tree_decomposition::flatten(root);
+    unsigned int const n = t.bags.size();
+    std::vector<std::vector<unsigned int> > children(n);
+    for (unsigned int i = 1; i < n; ++i)
+      children[t.parent[i]].push_back(i);
+
+    std::map<std::vector<unsigned int>, unsigned int> bag_shapes, projection_shapes;
+    auto number = [](std::map<std::vector<unsigned int>, unsigned int>& m,
+      std::vector<unsigned int>& x) {
+      return m.emplace(std::move(x), m.size()).first->second;
+    };
+    std::vector<unsigned int> shape(n, 0);
+    std::vector<unsigned int> code, A_to_B;
+    for (unsigned int i = n; i-- > 1; ) {
+      auto const& b = t.bags[i];
+      code.assign(1, b->vertices.size());
+      for (auto const& e : b->edges) {
+        code.push_back(b->vertices.index(e.first));
+        code.push_back(b->vertices.index(e.second));
+        code.push_back(op.edge_class(e));
       }
+      for (auto c : children[i]) {
+        project_mapping(t.bags[c], b, A_to_B);
+        code.push_back(shape[c]);
+        code.insert(code.end(), A_to_B.begin(), A_to_B.end());
+      }
+      unsigned int const bag_shape = number(bag_shapes, code);
 
-      // create b_sib to b bag mapping
-      auto const A_size = b_sib_left_over.size();
-      std::vector<unsigned int> A_to_B(A_size);
-      for (unsigned int i = 0; i < A_size; ++i)
-        A_to_B[i] = b->vertices.index(b_sib_left_over.at(i));
+      auto const& p = t.bags[t.parent[i]];
+      code.assign(1, bag_shape);
+      for (auto v : b->vertices) {
+        if (p->vertices.has(v))
+          code.push_back(b->vertices.index(v));
+      }
+      shape[i] = number(projection_shapes, code);
+    }
 
-      table = op.table_fusion(A_to_B, table_sib, table);
+    reuse_plan plan;
+    std::unordered_map<unsigned int, unsigned int> first;
+    std::vector<unsigned int> stack(children[0].rbegin(), children[0].rend());
+    while (not stack.empty()) {
+      unsigned int const i = stack.back();
+      stack.pop_back();
+      auto it = first.find(shape[i]);
+      if (it != first.end()) {
+        plan.owner[t.bags[i].get()] = t.bags[it->second].get();
+        ++ plan.followers[t.bags[it->second].get()];
+        continue;
+      }
+      first.emplace(shape[i], i);
+      stack.insert(stack.end(), children[i].rbegin(), children[i].rend());
     }
+    return plan;
+  }
 
-    // apply the join operator for each edge in the bag
-    for (auto e : b->edges) {
-      table = op.join_operator(b->vertices.index(e.first),
-        b->vertices.index(e.second), table);
+  // Post-order traversal with an explicit stack, deep decompositions
+  // (e.g. path decompositions of large graphs) would otherwise overflow
+  // the call stack. Each frame holds a bag, its table so far and the
+  // next child to visit. A bag gets its empty state only when its first
+  // child is done, so only the tables of bags with a finished child are
+  // alive at any time, hence the importance of visiting heavy children
+  // first (see tree_decomposition::minimize_peak_memory).
+  template<class Operators>
+  typename Operators::table_type
+  recurse(const Operators& op, bag_ptr root, options const& opt = options())
+  {
+    using table_type = typename Operators::table_type;
+    struct frame {
+      bag_ptr b;
+      bool has_table;
+      table_type table;
+      std::size_t next_child;
+    };
+
+    reuse_plan const plan = opt.reuse and not opt.checkpoints
+      ? plan_reuse(op, root) : reuse_plan();
+    // projected tables of owners, with the followers still to come
+    std::unordered_map<bag_ptr::element_type const*,
+      std::pair<std::shared_ptr<table_type const>, unsigned int> > shared;
+
+    // fuses the projected table of a child into f, sharing it with the
+    // followers of the child if it is an owner
+    auto deliver = [&](frame& f, bag_ptr b_sib, std::vector<unsigned int> const& A_to_B,
+      table_type&& table_sib) {
+      if (not f.has_table) {
+        f.table = empty_state(op, f.b, opt);
+        f.has_table = true;
+      }
+      auto it = plan.followers.find(b_sib.get());
+      if (it == plan.followers.end()) {
+        fuse(op, f.b, A_to_B, std::move(table_sib), f.table, opt);
+        return;
+      }
+      auto t = share(std::move(table_sib), opt);
+      fuse_shared(op, f.b, A_to_B, *t, f.table, opt);
+      shared[b_sib.get()] = std::make_pair(std::move(t), it->second);
+    };
+
+    std::vector<frame> stack;
+    stack.push_back(frame{root, false, table_type(), 0});
+    while (true) {
+      frame& f = stack.back();
+      if (f.next_child < f.b->children.size()) {
+        auto b_sib = f.b->children[f.next_child++];
+        table_type table_sib;
+        std::vector<unsigned int> A_to_B;
+        auto owner = plan.owner.find(b_sib.get());
+        if (owner != plan.owner.end()) {
+          auto it = shared.find(owner->second);
+          if (not f.has_table) {
+            f.table = empty_state(op, f.b, opt);
+            f.has_table = true;
+          }
+          project_mapping(b_sib, f.b, A_to_B);
+          fuse_shared(op, f.b, A_to_B, *it->second.first, f.table, opt);
+          if (opt.stats)
+            opt.stats->reuse();
+          if (-- it->second.second == 0)
+            shared.erase(it);
+        } else if (restore(op, b_sib, f.b, table_sib, A_to_B, opt)) {
+          deliver(f, b_sib, A_to_B, std::move(table_sib));
+        } else {
+          stack.push_back(frame{b_sib, false, table_type(), 0});
+        }
+        continue;
+      }
+
+      if (not f.has_table)
+        f.table = empty_state(op, f.b, opt);
+      join_edges(op, f.b, f.table, opt);
+      if (stack.size() == 1)
+        return std::move(f.table);
+
+      frame child = std::move(f);
+      stack.pop_back();
+      std::vector<unsigned int> A_to_B;
+      auto table_sib = project(op, child.b, stack.back().b, std::move(child.table), A_to_B, opt);
+      deliver(stack.back(), child.b, A_to_B, std::move(table_sib));
     }
-    return table;
+  }
+
+  // Same as above, but sibling subtrees are independent tasks on a
+  // work-stealing pool. A bag is ready once all its children have been
+  // fused into its table; children are fused as they complete, in
+  // whatever order, which is fine since fusion is commutative and the
+  // weights are exact.
+  template<class Operators>
+  typename Operators::table_type
+  recurse(const Operators& op, bag_ptr root, parallel::thread_pool& pool,
+    options const& opt = options())
+  {
+    using table_type = typename Operators::table_type;
+    using projection = std::pair<std::vector<unsigned int>, std::shared_ptr<table_type const> >;
+
+    struct node {
+      bag_ptr b;
+      node* parent;
+      unsigned int pending;  // children not fused yet
+      bool busy;             // some thread is fusing into table
+      bool has_table;
+      bool restored;         // the subtree has a checkpoint
+      table_type table;
+      std::vector<projection> inbox;
+      std::vector<node*> followers;  // take the projection of this one
+      std::mutex m;
+    };
+
+    reuse_plan const plan = opt.reuse and not opt.checkpoints
+      ? plan_reuse(op, root) : reuse_plan();
+
+    // flatten the tree, leaves are listed in depth-first order so that
+    // they are picked up roughly in the same order as the serial code
+    std::deque<node> nodes;
+    std::vector<node*> leaves;
+    std::unordered_map<bag_ptr::element_type const*, node*> owners;
+    std::string const signature = opt.checkpoints ? op.signature() : std::string();
+    std::vector<std::pair<bag_ptr, node*> > stack{{root, nullptr}};
+    while (not stack.empty()) {
+      auto x = stack.back();
+      stack.pop_back();
+      nodes.emplace_back();
+      node& n = nodes.back();
+      n.b = x.first;
+      n.parent = x.second;
+      n.busy = n.has_table = false;
+      // followers wait for their owner, which comes first
+      auto owner = plan.owner.find(n.b.get());
+      if (owner != plan.owner.end()) {
+        owners.at(owner->second)->followers.push_back(&n);
+        n.restored = false;
+        n.pending = 0;
+        continue;
+      }
+      if (plan.followers.count(n.b.get()))
+        owners[n.b.get()] = &n;
+      // subtrees with a checkpoint are not visited
+      n.restored = n.parent and opt.checkpoints
+        and opt.checkpoints->exists(n.b, signature);
+      n.pending = n.restored ? 0 : x.first->children.size();
+      if (n.pending == 0)
+        leaves.push_back(&n);
+      if (n.restored)
+        continue;
+      for (auto it = x.first->children.rbegin(); it != x.first->children.rend(); ++it)
+        stack.emplace_back(*it, &n);
+    }
+
+    // hands x to p, and fuses what p has in its inbox unless another
+    // thread already does; returns whether p has all its children
+    auto deliver = [&](node* p, projection&& x) {
+      {
+        std::lock_guard<std::mutex> lock(p->m);
+        p->inbox.push_back(std::move(x));
+        if (p->busy)
+          return false;
+        p->busy = true;
+      }
+
+      // drain the parent's inbox, other threads may keep filling it
+      bool ready;
+      unsigned int fused = 0;
+      while (true) {
+        std::vector<projection> batch;
+        {
+          std::lock_guard<std::mutex> lock(p->m);
+          p->pending -= fused;
+          if (p->inbox.empty()) {
+            p->busy = false;
+            ready = (p->pending == 0);
+            break;
+          }
+          batch.swap(p->inbox);
+        }
+        for (auto& y : batch) {
+          if (not p->has_table) {
+            p->table = empty_state(op, p->b, opt);
+            p->has_table = true;
+          }
+          fuse_shared(op, p->b, y.first, *y.second, p->table, opt);
+          y.second.reset();
+        }
+        fused = batch.size();
+      }
+      return ready;
+    };
+
+    parallel::task_group group(pool);
+    std::function<void (node*)> finish = [&](node* n) {
+      while (true) {
+        node* p = n->parent;
+        projection x;
+        if (n->restored) {
+          table_type t;
+          if (not restore(op, n->b, p->b, t, x.first, opt))
+            throw std::runtime_error("checkpoint disappeared");
+          x.second = share(std::move(t), opt);
+        } else {
+          // all children of n have been fused, complete it
+          if (not n->has_table)
+            n->table = empty_state(op, n->b, opt);
+          join_edges(op, n->b, n->table, opt);
+          if (not p)
+            return;
+          x.second = share(project(op, n->b, p->b, std::move(n->table), x.first, opt), opt);
+        }
+        for (auto f : n->followers) {
+          projection y;
+          project_mapping(f->b, f->parent->b, y.first);
+          y.second = x.second;
+          if (opt.stats)
+            opt.stats->reuse();
+          node* const q = f->parent;
+          if (deliver(q, std::move(y)))
+            group.run([&finish, q] { finish(q); });
+        }
+        if (not deliver(p, std::move(x)))
+          return;
+        n = p;
+      }
+    };
+
+    for (auto leaf : leaves)
+      group.run([&finish, leaf] { finish(leaf); });
+    group.wait();
+
+    return std::move(nodes.front().table);
   }
 
   template<class Operators>
   typename Operators::weight_type
-  transfer(const Operators& op, bag_ptr b)
+  transfer(const Operators& op, bag_ptr b, options const& opt = options())
   {
-    auto table = recurse(op, b);
+    if (opt.profile)
+      opt.profile->begin_pass(op.signature());
+    auto table = opt.pool ? recurse(op, b, *opt.pool, opt) : recurse(op, b, opt);
 
     // we need to make a copy first because
     // 1) we need to keep the indices consistent while removing vertices
     // 2) we don't want to destroy the tree decomposition
     vertex_list v_to_remove(b->vertices);
     for (auto v : b->vertices) {
-      table = op.delete_operator(v_to_remove.index(v), table);
+      replace(table, timed(opt, b, profiling::deletion, table.size(), 0, [&] {
+            return op.delete_operator(v_to_remove.index(v), table);
+          }), opt);
       v_to_remove.remove(v);
     }
     assert(table.size() == 1);
+    if (opt.stats)
+      opt.stats->remove(table.size());
+    if (opt.profile)
+      opt.profile->end_pass();
     return table.begin()->second;
   }
 }
@@ -0,0 +1,266 @@
+/*
+ *  cost_model.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef COST_MODEL_HPP
+#define COST_MODEL_HPP
+
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace tree_decomposition {
+
+  // number of set partitions of n elements, computed with the Bell
+  // triangle in floating point since we only need orders of magnitude
+  inline double bell_number(unsigned int n)
+  {
+    static std::vector<double> bell;
+    if (bell.empty()) {
+      std::vector<double> row{1.0};
+      bell.push_back(1.0);
+      for (unsigned int i = 1; i < 256; ++i) {
+        std::vector<double> next{row.back()};
+        for (auto x : row)
+          next.push_back(next.back() + x);
+        bell.push_back(next.front());
+        row.swap(next);
+      }
+    }
+    return bell[std::min<std::size_t>(n, bell.size() - 1)];
+  }
+
+  // upper bound on the number of states in the table of a bag with n
+  // vertices: every partition of its vertices
+  inline double estimated_states(unsigned int n)
+  {
+    return bell_number(n);
+  }
+
+  // number of non-crossing partitions of n elements, which bounds the
+  // states of a bag whose vertices all lie on one face of a planar
+  // graph, as in transfer matrices along the boundary of a lattice
+  inline double catalan_number(unsigned int n)
+  {
+    double c = 1;
+    for (unsigned int k = 0; k < n; ++k)
+      c = c * 2 * (2 * k + 1) / (k + 2);
+    return c;
+  }
+
+  typedef double (*states_bound)(unsigned int);
+
+  inline unsigned int intersection_size(vertex_list const& a, vertex_list const& b)
+  {
+    unsigned int n = 0;
+    for (auto v : a)
+      n += b.has(v);
+    return n;
+  }
+
+  // the bags of a tree decomposition in pre-order, each with the index
+  // of its parent (-1 for the root)
+  struct flat_tree {
+    std::vector<bag_ptr> bags;
+    std::vector<int> parent;
+  };
+
+  inline flat_tree flatten(bag_ptr root)
+  {
+    flat_tree t;
+    std::vector<std::pair<bag_ptr, int> > stack{{root, -1}};
+    while (not stack.empty()) {
+      auto x = stack.back();
+      stack.pop_back();
+      int const i = t.bags.size();
+      t.bags.push_back(x.first);
+      t.parent.push_back(x.second);
+      for (auto it = x.first->children.rbegin(); it != x.first->children.rend(); ++it)
+        stack.emplace_back(*it, i);
+    }
+    return t;
+  }
+
+  // Memory model of transfer::recurse, in number of live table entries.
+  // A bag fuses its children one at a time into the empty state, which
+  // is created once the first child is done; after fusing a child its
+  // table grows by the number of states of the child's projection, up
+  // to all the partitions of the bag. While a child's subtree runs the
+  // parent table stays alive, and each operator keeps its input alive
+  // while building its output.
+  class peak_model {
+    states_bound states_;
+    std::vector<vertex_list const*> vertices_;
+    std::vector<bool> has_edges_;
+    std::vector<std::vector<unsigned int> > adjacent_;
+
+  public:
+    explicit peak_model(flat_tree const& t, states_bound states = estimated_states)
+      : states_(states), vertices_(t.bags.size()), has_edges_(t.bags.size())
+      , adjacent_(t.bags.size())
+    {
+      for (unsigned int i = 0; i < t.bags.size(); ++i) {
+        vertices_[i] = &t.bags[i]->vertices;
+        has_edges_[i] = not t.bags[i]->edges.empty();
+        if (t.parent[i] >= 0) {
+          adjacent_[i].push_back(t.parent[i]);
+          adjacent_[t.parent[i]].push_back(i);
+        }
+      }
+    }
+
+    // peak with the tree rooted at r, children[i] is filled with the
+    // children of i, sorted so that the subtree with the highest peak
+    // runs first while the table of i is still small
+    double peak(unsigned int r, std::vector<std::vector<unsigned int> >& children) const
+    {
+      unsigned int const n = vertices_.size();
+      std::vector<int> parent(n, -1);
+      std::vector<unsigned int> order{r};
+      order.reserve(n);
+      parent[r] = r;
+      for (unsigned int k = 0; k < order.size(); ++k) {
+        for (auto j : adjacent_[order[k]]) {
+          if (parent[j] == -1) {
+            parent[j] = order[k];
+            order.push_back(j);
+          }
+        }
+      }
+
+      children.assign(n, std::vector<unsigned int>());
+      std::vector<double> peak(n), projected(n);
+      for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        unsigned int const i = *it;
+        for (auto j : adjacent_[i]) {
+          if (parent[j] == (int) i and j != r)
+            children[i].push_back(j);
+        }
+        std::sort(children[i].begin(), children[i].end(),
+          [&](unsigned int a, unsigned int b) {
+            return peak[a] > peak[b] or (peak[a] == peak[b] and projected[a] < projected[b]);
+          });
+
+        double const full = states_(vertices_[i]->size());
+        // the empty state is created when the first child is done
+        double table = 0, p = 0;
+        for (auto j : children[i]) {
+          p = std::max(p, table + peak[j]);
+          table = std::max(table, 1.0);
+          double const fused = std::min(full, table * projected[j]);
+          p = std::max(p, table + projected[j] + fused);
+          table = fused;
+        }
+        table = std::max(table, 1.0);
+        if (has_edges_[i]) {
+          p = std::max(p, table + full);
+          table = full;
+        }
+        // deleting vertices on the way to the parent (or at the end)
+        p = std::max(p, 2 * table);
+        peak[i] = p;
+        if (i != r) {
+          projected[i] = states_(
+            intersection_size(*vertices_[i], *vertices_[parent[i]]));
+        }
+      }
+      return peak[r];
+    }
+  };
+
+  // estimated peak of the tree decomposition as it is
+  inline double predicted_peak(bag_ptr root, states_bound states = estimated_states)
+  {
+    std::vector<std::vector<unsigned int> > children;
+    return peak_model(flatten(root), states).peak(0, children);
+  }
+
+  // Estimated work of transfer on the tree decomposition, in table
+  // entries visited: each bag pays its states once per edge and per
+  // vertex deleted on the way to its parent (all of them at the root),
+  // and the parent's states times the states of its projection for the
+  // fusion. If per_bag is given, it is filled with the work of each bag
+  // in pre-order.
+  inline double estimated_work(bag_ptr root, states_bound states = estimated_states,
+    std::vector<double>* per_bag = nullptr)
+  {
+    flat_tree const t = flatten(root);
+    unsigned int const n = t.bags.size();
+    std::vector<double> s(n), work(n, 0.0);
+    for (unsigned int i = 0; i < n; ++i)
+      s[i] = states(t.bags[i]->vertices.size());
+    for (unsigned int i = 0; i < n; ++i) {
+      auto const& b = t.bags[i];
+      int const p = t.parent[i];
+      unsigned int const kept = p < 0 ? 0
+        : intersection_size(b->vertices, t.bags[p]->vertices);
+      work[i] += s[i] * (b->edges.size() + b->vertices.size() - kept);
+      if (p >= 0)
+        work[p] += s[p] * states(kept);
+    }
+    double total = 0;
+    for (auto w : work)
+      total += w;
+    if (per_bag)
+      per_bag->swap(work);
+    return total;
+  }
+
+  // Reroots the tree decomposition and reorders the children of each
+  // bag to minimise the predicted peak. Candidate roots are the largest
+  // bags, at most max_candidates of them, and fewer on large trees so
+  // that about max_visits bags are visited in total. The model is only
+  // an upper bound (planar graphs, for instance, have far fewer states
+  // than the Bell number) so the root is moved only if the predicted
+  // peak drops by at least the given fraction. Returns the new root.
+  inline bag_ptr minimize_peak_memory(bag_ptr root,
+    unsigned int max_candidates = 512, double min_gain = 0.25,
+    double max_visits = 1 << 24)
+  {
+    flat_tree t = flatten(root);
+    peak_model model(t);
+    unsigned int const n = t.bags.size();
+    max_candidates = std::min<double>(max_candidates, std::max(1.0, max_visits / n));
+
+    std::vector<unsigned int> candidates(n);
+    for (unsigned int i = 0; i < n; ++i)
+      candidates[i] = i;
+    std::stable_sort(candidates.begin(), candidates.end(),
+      [&](unsigned int a, unsigned int b) {
+        return t.bags[a]->vertices.size() > t.bags[b]->vertices.size();
+      });
+    if (candidates.size() > max_candidates)
+      candidates.resize(max_candidates);
+
+    std::vector<std::vector<unsigned int> > children, best_children;
+    unsigned int best = 0;
+    double const threshold = (1 - min_gain) * model.peak(0, best_children);
+    double best_peak = threshold;
+    for (auto r : candidates) {
+      double const p = model.peak(r, children);
+      if (p < best_peak) {
+        best = r;
+        best_peak = p;
+        best_children.swap(children);
+      }
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+      t.bags[i]->children.clear();
+      for (auto j : best_children[i])
+        t.bags[i]->children.push_back(t.bags[j]);
+    }
+    return t.bags[best];
+  }
+}
+
+#endif
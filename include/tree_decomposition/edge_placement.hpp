@@ -0,0 +1,84 @@
+/*
+ *  edge_placement.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef EDGE_PLACEMENT_HPP
+#define EDGE_PLACEMENT_HPP
+
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <vector>
+
+namespace tree_decomposition {
+
+  // Moves each edge to the smallest bag holding both its ends, the one
+  // closest to the root among equally small ones. An edge can be joined
+  // in any bag holding both its ends, and those bags form a subtree;
+  // build_tree_decomposition puts it at the top of that subtree, where
+  // the table has all the children fused in, while a smaller bag has
+  // fewer states to join over. Going deeper than that does not pay: the
+  // states an edge creates then go through more fusions, whereas at the
+  // top they are merged by the deletion that follows. (Estimating the
+  // table at the time of the join by the product of the projections of
+  // the children, which favours leaves, is worse for this reason.)
+  // Returns the number of edges moved. The root matters, so this must
+  // run after rerooting.
+  inline std::size_t place_edges(bag_ptr root)
+  {
+    flat_tree const t = flatten(root);
+    unsigned int const n = t.bags.size();
+    std::vector<std::vector<unsigned int> > children(n);
+    std::vector<unsigned int> depth(n, 0);
+    for (unsigned int i = 1; i < n; ++i) {
+      children[t.parent[i]].push_back(i);
+      depth[i] = depth[t.parent[i]] + 1;
+    }
+
+    std::size_t moved = 0;
+    std::vector<edge_list> edges(n);
+    std::vector<unsigned int> stack;
+    for (unsigned int i = 0; i < n; ++i) {
+      for (auto e : t.bags[i]->edges) {
+        auto holds = [&](unsigned int j) {
+          return t.bags[j]->vertices.has(e.first) and t.bags[j]->vertices.has(e.second);
+        };
+        auto better = [&](unsigned int a, unsigned int b) {
+          auto const sa = t.bags[a]->vertices.size(), sb = t.bags[b]->vertices.size();
+          return sa < sb or (sa == sb and depth[a] < depth[b]);
+        };
+
+        unsigned int top = i;
+        while (t.parent[top] >= 0 and holds(t.parent[top]))
+          top = t.parent[top];
+        unsigned int best = top;
+        stack.assign(1, top);
+        while (not stack.empty()) {
+          unsigned int const j = stack.back();
+          stack.pop_back();
+          if (better(j, best))
+            best = j;
+          for (auto c : children[j]) {
+            if (holds(c))
+              stack.push_back(c);
+          }
+        }
+        edges[best].push_back(e);
+        moved += best != i;
+      }
+    }
+    for (unsigned int i = 0; i < n; ++i)
+      t.bags[i]->edges.swap(edges[i]);
+    return moved;
+  }
+}
+
+#endif
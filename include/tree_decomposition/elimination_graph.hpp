@@ -0,0 +1,198 @@
+/*
+ *  elimination_graph.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef ELIMINATION_GRAPH_HPP
+#define ELIMINATION_GRAPH_HPP
+
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace heuristics {
+
+  // A graph under vertex elimination, indexed by vertex index, for the
+  // ordering heuristics. It mirrors what heuristics::eliminate_vertex
+  // does to a boost adjacency list: parallel edges are kept (a loop
+  // counts twice, as in boost) and each vertex lists its neighbours in
+  // the order they first appear in its boost adjacency list, fill-in
+  // edges being appended, so that heuristics breaking ties on that order
+  // give the same results.
+  class elimination_graph {
+  public:
+    struct neighbor {
+      unsigned int vertex;
+      unsigned int multiplicity;
+    };
+
+  private:
+    std::vector<std::vector<neighbor> > adjacent_;
+    std::vector<unsigned int> degree_;
+    std::vector<bool> eliminated_;
+
+    // scratch space, marks are valid when equal to stamp_
+    mutable std::vector<unsigned int> mark_, weight_;
+    mutable unsigned int stamp_;
+
+    void new_stamp() const
+    {
+      if (++stamp_ == 0) {
+        std::fill(mark_.begin(), mark_.end(), 0);
+        stamp_ = 1;
+      }
+    }
+
+  public:
+    template<class Graph>
+    explicit elimination_graph(Graph const& g)
+      : adjacent_(num_vertices(g)), degree_(num_vertices(g), 0)
+      , eliminated_(num_vertices(g), false)
+      , mark_(num_vertices(g), 0), weight_(num_vertices(g), 0), stamp_(0)
+    {
+      using boost::vertex_index;
+      std::vector<unsigned int> position(num_vertices(g));
+      typename boost::graph_traits<Graph>::vertex_iterator vi, vi_end;
+      for (boost::tie(vi, vi_end) = vertices(g); vi != vi_end; ++vi) {
+        unsigned int const v = get(vertex_index, g, *vi);
+        auto& adj = adjacent_[v];
+        typename boost::graph_traits<Graph>::adjacency_iterator ai, ai_end;
+        for (boost::tie(ai, ai_end) = adjacent_vertices(*vi, g); ai != ai_end; ++ai) {
+          unsigned int const u = get(vertex_index, g, *ai);
+          ++ degree_[v];
+          if (mark_[u] == v + 1) {
+            ++ adj[position[u]].multiplicity;
+          } else {
+            mark_[u] = v + 1;
+            position[u] = adj.size();
+            adj.push_back(neighbor{u, 1});
+          }
+        }
+      }
+      std::fill(mark_.begin(), mark_.end(), 0);
+    }
+
+    unsigned int size() const { return adjacent_.size(); }
+
+    bool eliminated(unsigned int v) const { return eliminated_[v]; }
+
+    // as boost::degree, counting parallel edges
+    unsigned int degree(unsigned int v) const { return degree_[v]; }
+
+    // distinct neighbours, v itself included if it has a loop
+    std::vector<neighbor> const& neighbors(unsigned int v) const
+    {
+      return adjacent_[v];
+    }
+
+    // distinct neighbours other than v
+    unsigned int num_neighbors(unsigned int v) const
+    {
+      unsigned int n = 0;
+      for (auto const& x : adjacent_[v])
+        n += x.vertex != v;
+      return n;
+    }
+
+    // what heuristics::num_non_adjacent_neighbors returns on the boost
+    // graph: the pairs of entries (u, z) of the adjacency list of v such
+    // that z is adjacent to u
+    unsigned int adjacent_pairs(unsigned int v) const
+    {
+      new_stamp();
+      for (auto const& x : adjacent_[v]) {
+        mark_[x.vertex] = stamp_;
+        weight_[x.vertex] = x.multiplicity;
+      }
+      unsigned int n = 0;
+      for (auto const& x : adjacent_[v]) {
+        unsigned int inner = 0;
+        for (auto const& y : adjacent_[x.vertex]) {
+          if (mark_[y.vertex] == stamp_)
+            inner += weight_[y.vertex];
+        }
+        n += x.multiplicity * inner;
+      }
+      return n;
+    }
+
+    // edges missing between the neighbours of v (other than v), each
+    // counted twice
+    unsigned int fill_in(unsigned int v) const
+    {
+      unsigned int f = 0;
+      for (auto const& a : adjacent_[v]) {
+        if (a.vertex == v)
+          continue;
+        new_stamp();
+        for (auto const& x : adjacent_[a.vertex])
+          mark_[x.vertex] = stamp_;
+        for (auto const& b : adjacent_[v])
+          f += b.vertex != v and b.vertex != a.vertex and mark_[b.vertex] != stamp_;
+      }
+      return f;
+    }
+
+    // Eliminates v: its neighbours become a clique and v is removed.
+    // Returns the neighbours of v (other than v) in order, and if filled
+    // is given appends to it the neighbours which gained an edge.
+    std::vector<unsigned int> eliminate(unsigned int v,
+      std::vector<unsigned int>* filled = nullptr)
+    {
+      std::vector<unsigned int> n;
+      for (auto const& x : adjacent_[v]) {
+        if (x.vertex != v)
+          n.push_back(x.vertex);
+      }
+
+      // each pair once, adding to both ends keeps every list in the
+      // order boost would have
+      std::vector<bool> gained(n.size(), false);
+      for (std::size_t i = 0; i < n.size(); ++i) {
+        unsigned int const a = n[i];
+        new_stamp();
+        for (auto const& x : adjacent_[a])
+          mark_[x.vertex] = stamp_;
+        for (std::size_t j = i + 1; j < n.size(); ++j) {
+          unsigned int const b = n[j];
+          if (mark_[b] == stamp_)
+            continue;
+          adjacent_[a].push_back(neighbor{b, 1});
+          adjacent_[b].push_back(neighbor{a, 1});
+          ++ degree_[a];
+          ++ degree_[b];
+          gained[i] = gained[j] = true;
+        }
+      }
+      if (filled) {
+        for (std::size_t i = 0; i < n.size(); ++i) {
+          if (gained[i])
+            filled->push_back(n[i]);
+        }
+      }
+
+      for (auto a : n) {
+        auto& adj = adjacent_[a];
+        auto it = std::find_if(adj.begin(), adj.end(),
+          [v](neighbor const& x) { return x.vertex == v; });
+        degree_[a] -= it->multiplicity;
+        adj.erase(it);
+      }
+      adjacent_[v].clear();
+      degree_[v] = 0;
+      eliminated_[v] = true;
+      return n;
+    }
+  };
+}
+
+#endif
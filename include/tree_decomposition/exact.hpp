@@ -0,0 +1,368 @@
+/*
+ *  exact.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef EXACT_HPP
+#define EXACT_HPP
+
+#include "tree_decomposition/elimination_graph.hpp"
+#include "tree_decomposition/heuristics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace heuristics {
+
+  struct exact_result {
+    std::vector<unsigned int> order;
+    unsigned int width;        // size of the largest bag of order, minus one
+    unsigned int lower_bound;  // on the treewidth of the graph
+    bool optimal;              // the search completed, width is the treewidth
+    std::size_t nodes;         // search nodes visited
+  };
+
+  namespace detail {
+    typedef std::uint64_t word;
+
+    inline unsigned int popcount(word const* a, unsigned int words)
+    {
+      unsigned int n = 0;
+      for (unsigned int k = 0; k < words; ++k)
+        n += __builtin_popcountll(a[k]);
+      return n;
+    }
+
+    // A simple graph under elimination (parallel edges merged, loops
+    // dropped) as the rows of a matrix of bits, with the set of vertices
+    // not yet eliminated and their degrees.
+    struct bit_graph {
+      unsigned int words;
+      std::vector<word> rows;
+      std::vector<word> alive;
+      std::vector<unsigned int> degree;
+      unsigned int size;
+
+      explicit bit_graph(elimination_graph const& g)
+        : words((g.size() + 63) / 64), rows(g.size() * words, 0)
+        , alive(words, 0), degree(g.size(), 0), size(g.size())
+      {
+        for (unsigned int v = 0; v < g.size(); ++v) {
+          set(&alive[0], v);
+          for (auto const& x : g.neighbors(v)) {
+            if (x.vertex != v)
+              set(row(v), x.vertex);
+          }
+          degree[v] = popcount(row(v), words);
+        }
+      }
+
+      word* row(unsigned int v) { return &rows[v * words]; }
+      word const* row(unsigned int v) const { return &rows[v * words]; }
+
+      static bool has(word const* r, unsigned int u) { return r[u / 64] >> (u % 64) & 1; }
+      static void set(word* r, unsigned int u) { r[u / 64] |= word(1) << (u % 64); }
+      static void reset(word* r, unsigned int u) { r[u / 64] &= ~(word(1) << (u % 64)); }
+
+      // calls f on the elements of r, in increasing order
+      template<class F>
+      void for_each(word const* r, F f) const
+      {
+        for (unsigned int k = 0; k < words; ++k) {
+          for (word b = r[k]; b; b &= b - 1)
+            f(64 * k + __builtin_ctzll(b));
+        }
+      }
+
+      void remove(unsigned int v)
+      {
+        std::fill(row(v), row(v) + words, 0);
+        reset(&alive[0], v);
+        degree[v] = 0;
+        --size;
+      }
+
+      // the neighbours of v become a clique and v is removed
+      void eliminate(unsigned int v)
+      {
+        word const* rv = row(v);
+        for_each(rv, [&](unsigned int u) {
+          word* ru = row(u);
+          for (unsigned int k = 0; k < words; ++k)
+            ru[k] |= rv[k];
+          reset(ru, u);
+          reset(ru, v);
+          degree[u] = popcount(ru, words);
+        });
+        remove(v);
+      }
+
+      // the edge v-u is contracted into u
+      void contract(unsigned int v, unsigned int u)
+      {
+        word const* rv = row(v);
+        word* ru = row(u);
+        for_each(rv, [&](unsigned int w) {
+          if (w != u) {
+            word* rw = row(w);
+            reset(rw, v);
+            set(rw, u);
+            degree[w] = popcount(rw, words);
+          }
+        });
+        for (unsigned int k = 0; k < words; ++k)
+          ru[k] |= rv[k];
+        reset(ru, u);
+        reset(ru, v);
+        degree[u] = popcount(ru, words);
+        remove(v);
+      }
+
+      // Eliminating v is safe when it is simplicial (its neighbours form
+      // a clique) or, provided its degree is at most a lower bound on the
+      // treewidth, almost simplicial (all its neighbours but one do).
+      bool reducible(unsigned int v, unsigned int low) const
+      {
+        word const* rv = row(v);
+        unsigned int missing = 0, worst = 0;
+        for_each(rv, [&](unsigned int u) {
+          word const* ru = row(u);
+          unsigned int m = 0;
+          for (unsigned int k = 0; k < words; ++k)
+            m += __builtin_popcountll(rv[k] & ~ru[k]);
+          // u itself is not in its row
+          missing += m - 1;
+          worst = std::max(worst, m - 1);
+        });
+        missing /= 2;
+        return missing == 0 or (degree[v] <= low and missing == worst);
+      }
+
+      // edges missing between the neighbours of v
+      unsigned int fill_in(unsigned int v) const
+      {
+        word const* rv = row(v);
+        unsigned int missing = 0;
+        for_each(rv, [&](unsigned int u) {
+          word const* ru = row(u);
+          for (unsigned int k = 0; k < words; ++k)
+            missing += __builtin_popcountll(rv[k] & ~ru[k]);
+          missing -= 1;
+        });
+        return missing / 2;
+      }
+
+      // largest degree at elimination, eliminating the whole graph in
+      // the given order
+      unsigned int width(std::vector<unsigned int> const& order) const
+      {
+        bit_graph h = *this;
+        unsigned int w = 0;
+        for (auto v : order) {
+          w = std::max(w, h.degree[v]);
+          h.eliminate(v);
+        }
+        return w;
+      }
+
+      // Minor-min-width: the minimum degree of a graph bounds its
+      // treewidth from below, and so does that of its minors. Contracts
+      // a vertex of minimum degree into its neighbour of minimum degree
+      // until the graph is too small to beat the bound.
+      unsigned int lower_bound() const
+      {
+        bit_graph h = *this;
+        unsigned int const n = degree.size();
+        unsigned int low = 0;
+        while (h.size > low + 1) {
+          unsigned int v = n;
+          for (unsigned int k = 0; k < words; ++k) {
+            for (word b = h.alive[k]; b; b &= b - 1) {
+              unsigned int const x = 64 * k + __builtin_ctzll(b);
+              if (v == n or h.degree[x] < h.degree[v])
+                v = x;
+            }
+          }
+          low = std::max(low, h.degree[v]);
+          if (h.degree[v] == 0) {
+            h.remove(v);
+            continue;
+          }
+          unsigned int u = n;
+          h.for_each(h.row(v), [&](unsigned int x) {
+            if (u == n or h.degree[x] < h.degree[u])
+              u = x;
+          });
+          h.contract(v, u);
+        }
+        return low;
+      }
+    };
+
+    struct words_hash {
+      std::size_t operator()(std::vector<word> const& a) const
+      {
+        std::size_t h = 0;
+        for (auto x : a)
+          h = h * 0x9e3779b97f4a7c15ull + x;
+        return h;
+      }
+    };
+
+    // Depth first search over elimination orders. Each node eliminates
+    // the reducible vertices, then branches on the others, least fill-in
+    // first, so that the first descent follows the greedy fill-in
+    // heuristic. A node is pruned when the width so far or the
+    // minor-min-width of what is left reaches the best width found, or
+    // when the same set of vertices has already been eliminated with no
+    // larger width (the graph left only depends on the set).
+    class branch_and_bound {
+      typedef std::chrono::steady_clock clock;
+
+      clock::time_point deadline_;
+      unsigned int root_bound_;
+      std::unordered_map<std::vector<word>, unsigned int, words_hash> seen_;
+      std::size_t max_seen_;
+      std::vector<unsigned int> prefix_;
+
+    public:
+      std::vector<unsigned int> best;
+      unsigned int upper;
+      std::size_t nodes;
+      bool timed_out;
+
+      branch_and_bound(bit_graph const& g, std::vector<unsigned int> order,
+        double seconds, unsigned int root_bound)
+        : deadline_(clock::now()
+            + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds)))
+        , root_bound_(root_bound)
+        , max_seen_((std::size_t(1) << 22) / g.words)
+        , best(std::move(order)), upper(g.width(best)), nodes(0), timed_out(false)
+      {
+      }
+
+      void search(bit_graph g, unsigned int width)
+      {
+        if ((++nodes & 255) == 0 and clock::now() >= deadline_)
+          timed_out = true;
+        if (timed_out)
+          return;
+
+        std::size_t const depth = prefix_.size();
+        unsigned int const n = g.degree.size();
+        for (bool reduced = true; reduced; ) {
+          reduced = false;
+          for (unsigned int v = 0; v < n; ++v) {
+            if (bit_graph::has(&g.alive[0], v)
+                and g.reducible(v, std::max(width, root_bound_))) {
+              width = std::max(width, g.degree[v]);
+              g.eliminate(v);
+              prefix_.push_back(v);
+              reduced = true;
+            }
+          }
+        }
+
+        if (width >= upper) {
+          prefix_.resize(depth);
+          return;
+        }
+        // any order of what is left is as good
+        if (g.size <= width + 1) {
+          best = prefix_;
+          g.for_each(&g.alive[0], [&](unsigned int v) { best.push_back(v); });
+          upper = width;
+          prefix_.resize(depth);
+          return;
+        }
+
+        auto it = seen_.find(g.alive);
+        if (it != seen_.end() and it->second <= width) {
+          prefix_.resize(depth);
+          return;
+        }
+        if (it != seen_.end())
+          it->second = width;
+        else if (seen_.size() < max_seen_)
+          seen_.emplace(g.alive, width);
+
+        unsigned int const low = std::max(width, g.lower_bound());
+        if (low >= upper) {
+          prefix_.resize(depth);
+          return;
+        }
+
+        std::vector<std::tuple<unsigned int, unsigned int, unsigned int> > branches;
+        g.for_each(&g.alive[0], [&](unsigned int v) {
+          if (g.degree[v] < upper)
+            branches.emplace_back(g.fill_in(v), g.degree[v], v);
+        });
+        std::sort(branches.begin(), branches.end());
+        for (auto const& b : branches) {
+          unsigned int const v = std::get<2>(b);
+          if (g.degree[v] >= upper)
+            continue;
+          bit_graph h = g;
+          h.eliminate(v);
+          prefix_.push_back(v);
+          search(std::move(h), std::max(width, g.degree[v]));
+          prefix_.pop_back();
+          if (timed_out or upper <= low)
+            break;
+        }
+        prefix_.resize(depth);
+      }
+    };
+  }
+
+  // Searches for an elimination order of minimum width by branch and
+  // bound, for graphs of up to a few hundred vertices, where one unit
+  // of width saves much more time than the search costs. The best of
+  // the greedy degree and fill-in orders is the starting upper bound,
+  // and is returned if nothing narrower is found. After the given
+  // number of seconds the search stops, returning the best order so
+  // far with optimal set to false.
+  template<class Graph>
+  exact_result exact_order(Graph const& g, double seconds)
+  {
+    exact_result r;
+    r.nodes = 0;
+    unsigned int const n = num_vertices(g);
+    if (n == 0) {
+      r.width = r.lower_bound = 0;
+      r.optimal = true;
+      return r;
+    }
+
+    detail::bit_graph const h(elimination_graph{g});
+    std::vector<unsigned int> degree_order(n), fillin_order(n);
+    greedy_degree_order(g, degree_order.begin());
+    greedy_fillin_order(g, fillin_order.begin());
+    auto& order = h.width(fillin_order) < h.width(degree_order) ? fillin_order : degree_order;
+
+    unsigned int const low = h.lower_bound();
+    detail::branch_and_bound bb(h, order, seconds, low);
+    if (low < bb.upper)
+      bb.search(h, 0);
+
+    r.order = bb.best;
+    r.width = bb.upper;
+    r.optimal = not bb.timed_out;
+    r.lower_bound = r.optimal ? r.width : low;
+    r.nodes = bb.nodes;
+    return r;
+  }
+}
+
+#endif
@@ -14,96 +14,524 @@
 #ifndef HEURISTICS_HPP
 #define HEURISTICS_HPP
 
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/elimination_graph.hpp"
+
 #include <boost/range/algorithm.hpp>
 
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 namespace heuristics {
   using namespace boost;
 
-  template<class Vertex, class Graph>
-  void eliminate_vertex(Vertex v, Graph& g) {
-    for (auto a : as_range(adjacent_vertices(v, g))) {
-      for (auto b : as_range(adjacent_vertices(v, g))) {
-        if (a != b and not edge(a, b, g).second) {
-          add_edge(a, b, g);
+  // Tie breaking policies for the greedy heuristics: keep_first picks
+  // the first of equally good vertices (the one with the lowest index,
+  // or the first in an adjacency list), pick_random one of them
+  // uniformly at random.
+  struct keep_first {
+    static const bool random = false;
+    bool operator()(unsigned int) const { return false; }
+  };
+
+  template<class Rng>
+  struct pick_random {
+    static const bool random = true;
+    Rng* rng;
+    bool operator()(unsigned int ties) const { return (*rng)() % ties == 0; }
+  };
+
+  template<class Rng>
+  pick_random<Rng> random_ties(Rng& rng)
+  {
+    return pick_random<Rng>{&rng};
+  }
+
+  // like min_element, ties(n) tells whether the n-th minimum found
+  // replaces the previous ones
+  template<class Range, class Compare, class Ties>
+  auto pick_min(Range const& r, Compare comp, Ties ties) -> decltype(boost::begin(r))
+  {
+    auto best = boost::begin(r);
+    unsigned int n = 1;
+    for (auto it = best; it != boost::end(r); ++it) {
+      if (it == best)
+        continue;
+      if (comp(*it, *best)) {
+        best = it;
+        n = 1;
+      } else if (not comp(*best, *it) and ties(++n)) {
+        best = it;
+      }
+    }
+    return best;
+  }
+
+  // Vertices keyed by a score, lowest first, ties by lowest index.
+  template<class Score = unsigned int>
+  class vertex_queue {
+    std::set<std::pair<Score, unsigned int> > queue_;
+    std::vector<Score> score_;
+
+  public:
+    explicit vertex_queue(unsigned int n) : score_(n) {}
+
+    bool empty() const { return queue_.empty(); }
+
+    // the vertex that pop would return, if there are no ties
+    unsigned int top() const { return queue_.begin()->second; }
+
+    void push(unsigned int v, Score const& score)
+    {
+      score_[v] = score;
+      queue_.emplace(score, v);
+    }
+
+    void update(unsigned int v, Score const& score)
+    {
+      if (score == score_[v])
+        return;
+      queue_.erase(std::make_pair(score_[v], v));
+      push(v, score);
+    }
+
+    template<class Ties>
+    unsigned int pop(Ties ties)
+    {
+      auto best = queue_.begin();
+      if (Ties::random) {
+        unsigned int n = 1;
+        for (auto it = std::next(best); it != queue_.end() and it->first == best->first; ++it) {
+          if (ties(++n))
+            best = it;
         }
       }
+      unsigned int const v = best->second;
+      queue_.erase(best);
+      return v;
+    }
+  };
+
+  // Repeatedly eliminates the vertex of lowest degree (counting
+  // parallel edges). Only the neighbours of the eliminated vertex
+  // change degree, so only they are updated in the queue.
+  template<class Graph, class OutputIterator, class Ties = keep_first>
+  void greedy_degree_order(Graph const& g, OutputIterator out, Ties ties = Ties()) {
+    elimination_graph h(g);
+    vertex_queue<> queue(h.size());
+    for (unsigned int v = 0; v < h.size(); ++v)
+      queue.push(v, h.degree(v));
+    while (not queue.empty()) {
+      unsigned int const v = queue.pop(ties);
+      *out++ = v;
+      for (auto u : h.eliminate(v))
+        queue.update(u, h.degree(u));
     }
-    clear_vertex(v, g);
-    remove_vertex(v, g);
   }
 
-  template<class Graph, class Vertex>
-  unsigned int num_non_adjacent_neighbors(Vertex v, Graph const& g)
+  //////////////////////////////////////////////////////////////////////
+
+  // Eliminates v from h and sets affected to the vertices whose
+  // neighbours, or the edges between them, may have changed: the
+  // neighbours of v and, when a fill-in edge a-b is added, the
+  // neighbours of a (among which the common neighbours of a and b).
+  inline void eliminate_affecting(elimination_graph& h, unsigned int v,
+    std::vector<unsigned int>& affected, std::vector<bool>& seen)
   {
-    unsigned int n = 0;
-    for (auto u : as_range(adjacent_vertices(v, g))) {
-      auto adj = adjacent_vertices(u, g);
-      for (auto z : as_range(adjacent_vertices(v, g))) {
-        if (boost::find(adj, z) != end(adj))
-          n ++;
+    std::vector<unsigned int> filled;
+    affected = h.eliminate(v, &filled);
+    for (auto u : affected)
+      seen[u] = true;
+    for (auto a : filled) {
+      for (auto const& x : h.neighbors(a)) {
+        if (not seen[x.vertex]) {
+          seen[x.vertex] = true;
+          affected.push_back(x.vertex);
+        }
       }
     }
-    return n;
+    for (auto u : affected)
+      seen[u] = false;
   }
 
-  template<class Graph, class OutputIterator>
-  void greedy_degree_order(Graph g, OutputIterator out) {
-    using vertex = typename Graph::vertex_descriptor;
-    while (num_vertices(g) > 0) {
-      auto v = *min_element(vertices(g), [&](vertex v, vertex u) {
-        return degree(v, g) < degree(u, g);
-      });
-      *out++ = get(vertex_index, g, v);
-      eliminate_vertex(v, g);
+  // Repeatedly eliminates the vertex v with the lowest
+  // elimination_graph::adjacent_pairs. The score of w depends on the
+  // neighbours of w and on the edges between them, so only the vertices
+  // given by eliminate_affecting are updated in the queue.
+  template<class Graph, class OutputIterator, class Ties = keep_first>
+  void greedy_fillin_order(Graph const& g, OutputIterator out, Ties ties = Ties()) {
+    elimination_graph h(g);
+    vertex_queue<> queue(h.size());
+    for (unsigned int v = 0; v < h.size(); ++v)
+      queue.push(v, h.adjacent_pairs(v));
+    std::vector<unsigned int> affected;
+    std::vector<bool> seen(h.size(), false);
+    while (not queue.empty()) {
+      unsigned int const v = queue.pop(ties);
+      *out++ = v;
+      eliminate_affecting(h, v, affected, seen);
+      for (auto u : affected)
+        queue.update(u, h.adjacent_pairs(u));
     }
   }
 
   //////////////////////////////////////////////////////////////////////
 
-  template<class Graph, class OutputIterator>
-  void greedy_fillin_order(Graph g, OutputIterator out) {
-    using vertex = typename Graph::vertex_descriptor;
-    while (num_vertices(g) > 0) {
-      auto v = *min_element(vertices(g), [&](vertex v, vertex u) {
-        return num_non_adjacent_neighbors(v, g) < num_non_adjacent_neighbors(u, g);
-      });
-      *out++ = get(vertex_index, g, v);
-      eliminate_vertex(v, g);
+  // The 'local' heuristics pick the next vertex among the neighbours of
+  // the one just eliminated, in the order of its adjacency list (among
+  // all vertices if it has none).
+  template<class Graph, class OutputIterator, class Score, class Ties>
+  void local_order(Graph const& g, OutputIterator out, Score score, Ties ties) {
+    elimination_graph h(g);
+    std::vector<std::pair<unsigned int, unsigned int> > candidates;
+    auto compare = [](std::pair<unsigned int, unsigned int> const& a,
+      std::pair<unsigned int, unsigned int> const& b) {
+      return a.first < b.first;
+    };
+    auto pick_any = [&]() {
+      candidates.clear();
+      for (unsigned int v = 0; v < h.size(); ++v) {
+        if (not h.eliminated(v))
+          candidates.emplace_back(score(h, v), v);
+      }
+      return pick_min(candidates, compare, ties)->second;
+    };
+
+    unsigned int current = pick_any();
+    for (unsigned int k = 1; k <= h.size(); ++k) {
+      *out++ = current;
+      candidates.clear();
+      for (auto const& x : h.neighbors(current)) {
+        if (x.vertex != current)
+          candidates.emplace_back(score(h, x.vertex), x.vertex);
+      }
+      bool const isolated = candidates.empty();
+      unsigned int const next = isolated ? current : pick_min(candidates, compare, ties)->second;
+      h.eliminate(current);
+      if (k == h.size())
+        break;
+      current = isolated ? pick_any() : next;
     }
   }
 
+  template<class Graph, class OutputIterator, class Ties = keep_first>
+  void greedy_local_degree_order(Graph const& g, OutputIterator out, Ties ties = Ties()) {
+    local_order(g, out, [](elimination_graph const& h, unsigned int v) {
+      return h.degree(v);
+    }, ties);
+  }
+
   //////////////////////////////////////////////////////////////////////
 
-  template<class Graph, class OutputIterator>
-  void greedy_local_degree_order(Graph g, OutputIterator out) {
-    using vertex = typename Graph::vertex_descriptor;
-    auto compare = [&](vertex v, vertex u) {
-      return degree(v, g) < degree(u, g);
-    };
-    vertex current = *min_element(vertices(g), compare);
-    while (num_vertices(g) > 0) {
-      *out++ = get(vertex_index, g, current);
-      vertex next = *min_element(vertices(g), compare);
-      eliminate_vertex(current, g);
-      current = next;
-    }
+  template<class Graph, class OutputIterator, class Ties = keep_first>
+  void greedy_local_fillin_order(Graph const& g, OutputIterator out, Ties ties = Ties()) {
+    local_order(g, out, [](elimination_graph const& h, unsigned int v) {
+      return h.adjacent_pairs(v);
+    }, ties);
   }
 
   //////////////////////////////////////////////////////////////////////
 
+  // Cost of running transfer on the tree decomposition built from an
+  // elimination order, with the model of estimate::bounds: the bag of
+  // each vertex v holds v and its neighbours at elimination, has the
+  // Bell number of its size as states, and its parent is the bag of the
+  // first of those neighbours to be eliminated. Each bag pays its states
+  // once per edge and per deleted vertex, and its parent's states times
+  // the states of its projection for the fusion.
+  class elimination_cost {
+    elimination_graph graph_;
+    // edges of the original graph (with multiplicity) per vertex
+    std::vector<std::vector<unsigned int> > edges_;
+
+  public:
+    template<class Graph>
+    explicit elimination_cost(Graph const& g)
+      : graph_(g), edges_(num_vertices(g))
+    {
+      for (auto e : as_range(boost::edges(g))) {
+        unsigned int const a = get(vertex_index, g, source(e, g));
+        unsigned int const b = get(vertex_index, g, target(e, g));
+        edges_[a].push_back(b);
+        edges_[b].push_back(a);
+      }
+    }
+
+    elimination_graph const& graph() const { return graph_; }
+
+    // the cost of the bag of v, whose neighbours at elimination are
+    // bag, and of fusing it into its parent; bag_size gives the size of
+    // the bag of each vertex, position its place in the order
+    template<class BagSize>
+    double bag_cost(unsigned int v, std::vector<unsigned int> const& bag,
+      std::vector<unsigned int> const& position, BagSize bag_size) const
+    {
+      using tree_decomposition::bell_number;
+      unsigned int const n = position.size();
+      unsigned int const i = position[v];
+      unsigned int first = n, parent = n;
+      for (auto u : bag) {
+        if (position[u] < first) {
+          first = position[u];
+          parent = u;
+        }
+      }
+      unsigned int genuine = 0;
+      for (auto u : edges_[v])
+        genuine += position[u] >= i;
+      double const states = bell_number(bag.size() + 1);
+      if (parent == n)
+        return states * (genuine + bag.size() + 1);
+      return states * (genuine + 1) + bell_number(bag_size(parent)) * bell_number(bag.size());
+    }
+
+    double operator()(std::vector<unsigned int> const& order) const
+    {
+      unsigned int const n = order.size();
+      std::vector<unsigned int> position(n);
+      for (unsigned int i = 0; i < n; ++i)
+        position[order[i]] = i;
+
+      elimination_graph h = graph_;
+      std::vector<std::vector<unsigned int> > bag(n);
+      for (auto v : order)
+        bag[v] = h.eliminate(v);
+      double cost = 0;
+      for (unsigned int v = 0; v < n; ++v) {
+        cost += bag_cost(v, bag[v], position,
+          [&](unsigned int u) { return bag[u].size() + 1; });
+      }
+      return cost;
+    }
+  };
+
+  // elimination_cost of an order under moves of single vertices. The
+  // graph left by eliminating a set of vertices does not depend on the
+  // order in which they were eliminated: its edges are those of the
+  // original graph and those between the neighbours at elimination of
+  // each of them. So moving a vertex from position i to position j only
+  // changes the bags of the vertices between the two, which are rebuilt
+  // from the bags of the earlier vertices, and the parents of the
+  // earlier vertices whose bags meet them.
+  class incremental_cost {
+    elimination_cost const& cost_;
+    std::vector<unsigned int> order_, position_;
+    std::vector<std::vector<unsigned int> > bag_;
+    std::vector<std::vector<unsigned int> > in_bags_;  // the vertices whose bag holds v
+    double total_;
+
+    // scratch space, marks are valid when equal to stamp_
+    std::vector<unsigned int> mark_;
+    unsigned int stamp_;
+    std::vector<std::vector<unsigned int> > extra_;
+
+    void new_stamp()
+    {
+      if (++stamp_ == 0) {
+        std::fill(mark_.begin(), mark_.end(), 0);
+        stamp_ = 1;
+      }
+    }
+
+    double bag_cost(unsigned int v) const
+    {
+      return cost_.bag_cost(v, bag_[v], position_,
+        [&](unsigned int u) { return bag_[u].size() + 1; });
+    }
+
+  public:
+    incremental_cost(elimination_cost const& cost, std::vector<unsigned int> const& order)
+      : cost_(cost), order_(order), position_(order.size()), bag_(order.size())
+      , in_bags_(order.size()), total_(0), mark_(order.size(), 0), stamp_(0)
+      , extra_(order.size())
+    {
+      unsigned int const n = order.size();
+      for (unsigned int i = 0; i < n; ++i)
+        position_[order[i]] = i;
+      elimination_graph h = cost.graph();
+      for (auto v : order) {
+        bag_[v] = h.eliminate(v);
+        for (auto u : bag_[v])
+          in_bags_[u].push_back(v);
+      }
+      for (unsigned int v = 0; v < n; ++v)
+        total_ += bag_cost(v);
+    }
+
+    std::vector<unsigned int> const& order() const { return order_; }
+
+    double total() const { return total_; }
+
+    // moves the vertex at position i to position j, if that does not
+    // increase the cost, and tells whether it did
+    bool move(unsigned int i, unsigned int j)
+    {
+      unsigned int const lo = std::min(i, j), hi = std::max(i, j);
+      std::vector<unsigned int> window(order_.begin() + lo, order_.begin() + hi + 1);
+
+      // the bags whose cost may change
+      std::vector<unsigned int> affected;
+      new_stamp();
+      for (auto w : window) {
+        mark_[w] = stamp_;
+        affected.push_back(w);
+      }
+      for (auto w : window) {
+        for (auto x : in_bags_[w]) {
+          if (position_[x] < lo and mark_[x] != stamp_) {
+            mark_[x] = stamp_;
+            affected.push_back(x);
+          }
+        }
+      }
+      double before = 0;
+      for (auto x : affected)
+        before += bag_cost(x);
+
+      std::vector<unsigned int> moved = window;
+      if (i < j)
+        std::rotate(moved.begin(), moved.begin() + 1, moved.end());
+      else
+        std::rotate(moved.begin(), moved.end() - 1, moved.end());
+      for (unsigned int k = lo; k <= hi; ++k)
+        position_[moved[k - lo]] = k;
+
+      // the neighbours of each vertex of the window when it is
+      // eliminated: its own and those it shares a bag with, in the
+      // bags of the vertices eliminated before it
+      std::vector<std::vector<unsigned int> > old_bags(window.size());
+      for (unsigned int k = 0; k < moved.size(); ++k) {
+        unsigned int const w = moved[k];
+        unsigned int const at = lo + k;
+        std::vector<unsigned int> bag;
+        new_stamp();
+        mark_[w] = stamp_;
+        auto add = [&](unsigned int u) {
+          if (mark_[u] != stamp_ and position_[u] > at) {
+            mark_[u] = stamp_;
+            bag.push_back(u);
+          }
+        };
+        for (auto const& x : cost_.graph().neighbors(w))
+          add(x.vertex);
+        for (auto x : in_bags_[w]) {
+          if (position_[x] < lo) {
+            for (auto u : bag_[x])
+              add(u);
+          }
+        }
+        for (auto u : extra_[w])
+          add(u);
+        extra_[w].clear();
+        for (auto u : bag) {
+          if (position_[u] <= hi)
+            extra_[u].insert(extra_[u].end(), bag.begin(), bag.end());
+        }
+        old_bags[k].swap(bag_[w]);
+        bag_[w].swap(bag);
+      }
+
+      double after = 0;
+      for (auto x : affected)
+        after += bag_cost(x);
+      if (after <= before) {
+        std::copy(moved.begin(), moved.end(), order_.begin() + lo);
+        for (unsigned int k = 0; k < moved.size(); ++k) {
+          unsigned int const w = moved[k];
+          for (auto u : old_bags[k]) {
+            auto& x = in_bags_[u];
+            x.erase(std::find(x.begin(), x.end(), w));
+          }
+          for (auto u : bag_[w])
+            in_bags_[u].push_back(w);
+        }
+        total_ += after - before;
+        return true;
+      }
+      for (unsigned int k = 0; k < moved.size(); ++k)
+        bag_[moved[k]].swap(old_bags[k]);
+      for (unsigned int k = lo; k <= hi; ++k)
+        position_[order_[k]] = k;
+      return false;
+    }
+  };
+
+  // Minimises elimination_cost. A few greedy orders, eliminating the
+  // vertex with fewest neighbours, then least fill-in, then at random,
+  // are refined by moving single vertices to nearby positions, keeping
+  // moves that do not increase the cost (see incremental_cost). The
+  // greedy orders use a vertex_queue in which the vertices given by
+  // eliminate_affecting have their fill-in taken as zero, and unknown,
+  // which puts them first among equals: it is only computed when they
+  // reach the front, so that vertices far from the minimum number of
+  // neighbours are not scored over and over. The random generator is
+  // seeded with seed, so that the order is reproducible.
   template<class Graph, class OutputIterator>
-  void greedy_local_fillin_order(Graph g, OutputIterator out) {
-    using vertex = typename Graph::vertex_descriptor;
-    auto compare =  [&](vertex v, vertex u) {
-      return num_non_adjacent_neighbors(v, g) < num_non_adjacent_neighbors(u, g);
+  void min_cost_order(Graph const& g, OutputIterator out,
+    unsigned int iterations = 2000, unsigned int restarts = 8,
+    unsigned int seed = 0)
+  {
+    elimination_cost cost(g);
+    unsigned int const n = cost.graph().size();
+    std::mt19937 rng(seed);
+
+    // neighbours, fill-in and whether it is known
+    typedef std::tuple<unsigned int, unsigned int, bool> score;
+    auto greedy = [&]() {
+      elimination_graph h = cost.graph();
+      vertex_queue<score> queue(n);
+      std::vector<bool> known(n, false);
+      for (unsigned int v = 0; v < n; ++v)
+        queue.push(v, score(h.num_neighbors(v), 0, false));
+      std::vector<unsigned int> order, affected;
+      std::vector<bool> seen(n, false);
+      while (not queue.empty()) {
+        unsigned int const u = queue.top();
+        if (not known[u]) {
+          known[u] = true;
+          queue.update(u, score(h.num_neighbors(u), h.fill_in(u), true));
+          continue;
+        }
+        unsigned int const v = queue.pop(random_ties(rng));
+        order.push_back(v);
+        eliminate_affecting(h, v, affected, seen);
+        for (auto w : affected) {
+          known[w] = false;
+          queue.update(w, score(h.num_neighbors(w), 0, false));
+        }
+      }
+      return order;
     };
-    vertex current = *min_element(vertices(g), compare);
-    while (num_vertices(g) > 0) {
-      *out++ = get(vertex_index, g, current);
-      vertex next = *min_element(adjacent_vertices(current, g), compare);
-      eliminate_vertex(current, g);
-      current = next;
+
+    std::vector<unsigned int> best;
+    double best_cost = 0;
+    for (unsigned int r = 0; r < std::max(1u, restarts); ++r) {
+      auto order = greedy();
+      double const c = cost(order);
+      // the cost overflows on very wide orders, keep the first
+      if (r == 0 or c < best_cost) {
+        best.swap(order);
+        best_cost = c;
+      }
     }
+
+    incremental_cost search(cost, best);
+    unsigned int const window = 8;
+    for (unsigned int k = 0; n > 1 and k < iterations; ++k) {
+      unsigned int const i = rng() % n;
+      unsigned int const lo = i > window ? i - window : 0;
+      unsigned int const hi = std::min(n - 1, i + window);
+      unsigned int const j = lo + rng() % (hi - lo + 1);
+      if (i != j)
+        search.move(i, j);
+    }
+
+    boost::copy(search.order(), out);
   }
 }
 
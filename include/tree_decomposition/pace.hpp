@@ -0,0 +1,218 @@
+/*
+ *  pace.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef PACE_HPP
+#define PACE_HPP
+
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+
+#include <algorithm>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Tree decompositions in the .td format of the PACE challenge, so that
+// they can be computed by dedicated treewidth solvers: comment lines
+// start with c, the solution line "s td N W n" gives the number of
+// bags, the size of the largest bag and the number of vertices, each
+// bag is a line "b i v1 v2 ..." and each edge of the tree a line "i j".
+// Bags and vertices are numbered from 1, vertex v of the file being
+// vertex v - 1 of the graph.
+
+namespace tree_decomposition {
+
+  // Reads a tree decomposition of g, checking that the bags form a
+  // tree, that every vertex and edge of g is in some bag and that the
+  // bags holding each vertex are connected. Each edge of g is placed in
+  // the smallest bag holding both its ends. The first bag is the root.
+  // Throws std::runtime_error if the decomposition is not valid.
+  template<class Graph>
+  bag_ptr read_pace(std::istream& in, Graph const& g)
+  {
+    using boost::vertex_index;
+    uint const n = num_vertices(g);
+
+    std::size_t line_number = 0;
+    auto fail = [&](std::string const& what) {
+      if (line_number > 0)
+        throw std::runtime_error("td file, line " + std::to_string(line_number) + ": " + what);
+      throw std::runtime_error("td file: " + what);
+    };
+
+    bool header = false;
+    std::size_t num_bags = 0, max_size = 0, vertices = 0;
+    std::vector<std::vector<uint> > bags;
+    std::vector<bool> declared;
+    std::vector<std::pair<uint, uint> > tree;
+
+    std::string line;
+    while (std::getline(in, line)) {
+      ++line_number;
+      std::istringstream l(line);
+      std::string first;
+      if (not (l >> first) or first == "c")
+        continue;
+
+      if (first == "s") {
+        std::string td;
+        if (header or not (l >> td >> num_bags >> max_size >> vertices) or td != "td")
+          fail("bad solution line");
+        if (vertices != n)
+          fail("the graph has " + std::to_string(n) + " vertices");
+        header = true;
+        bags.resize(num_bags);
+        declared.assign(num_bags, false);
+      } else if (not header) {
+        fail("expecting the solution line");
+      } else if (first == "b") {
+        std::size_t i, v;
+        if (not (l >> i) or i == 0 or i > num_bags or declared[i - 1])
+          fail("bad bag number");
+        declared[i - 1] = true;
+        auto& b = bags[i - 1];
+        while (l >> v) {
+          if (v == 0 or v > n)
+            fail("no vertex " + std::to_string(v));
+          b.push_back(v - 1);
+        }
+        if (not l.eof())
+          fail("bad vertex");
+        std::sort(b.begin(), b.end());
+        b.erase(std::unique(b.begin(), b.end()), b.end());
+        if (b.size() > max_size)
+          fail("bag larger than declared");
+      } else {
+        std::istringstream e(line);
+        std::size_t i, j;
+        std::string rest;
+        if (not (e >> i >> j) or e >> rest or i == 0 or i > num_bags
+            or j == 0 or j > num_bags or i == j)
+          fail("bad tree edge");
+        tree.emplace_back(i - 1, j - 1);
+      }
+    }
+
+    line_number = 0;
+    if (not header)
+      fail("missing solution line");
+    for (std::size_t i = 0; i < num_bags; ++i) {
+      if (not declared[i])
+        fail("bag " + std::to_string(i + 1) + " is missing");
+    }
+    if (num_bags == 0) {
+      if (n > 0)
+        fail("no bags");
+      return std::make_shared<bag>();
+    }
+
+    // a tree: num_bags - 1 edges, all bags reachable from the first
+    if (tree.size() != num_bags - 1)
+      fail("the bags do not form a tree");
+    std::vector<std::vector<uint> > adjacent(num_bags);
+    for (auto e : tree) {
+      adjacent[e.first].push_back(e.second);
+      adjacent[e.second].push_back(e.first);
+    }
+    std::vector<uint> order{0};
+    std::vector<int> parent(num_bags, -1);
+    parent[0] = 0;
+    for (std::size_t k = 0; k < order.size(); ++k) {
+      auto& a = adjacent[order[k]];
+      std::sort(a.begin(), a.end());
+      for (auto j : a) {
+        if (parent[j] == -1) {
+          parent[j] = order[k];
+          order.push_back(j);
+        }
+      }
+    }
+    if (order.size() != num_bags)
+      fail("the bags do not form a tree");
+
+    // in a tree the bags holding v are connected if and only if there
+    // is one tree edge less than bags between them
+    std::vector<std::vector<uint> > holders(n);
+    for (uint i = 0; i < num_bags; ++i) {
+      for (auto v : bags[i])
+        holders[v].push_back(i);
+    }
+    std::vector<std::size_t> inside(n, 0);
+    std::vector<uint> common;
+    for (auto e : tree) {
+      common.clear();
+      std::set_intersection(bags[e.first].begin(), bags[e.first].end(),
+        bags[e.second].begin(), bags[e.second].end(), std::back_inserter(common));
+      for (auto v : common)
+        ++ inside[v];
+    }
+    for (uint v = 0; v < n; ++v) {
+      if (holders[v].empty())
+        fail("vertex " + std::to_string(v) + " of the graph is in no bag");
+      if (inside[v] + 1 != holders[v].size())
+        fail("the bags holding vertex " + std::to_string(v) + " of the graph are not connected");
+    }
+
+    std::vector<bag_ptr> nodes(num_bags);
+    for (uint i = 0; i < num_bags; ++i) {
+      nodes[i] = std::make_shared<bag>();
+      for (auto v : bags[i])
+        nodes[i]->vertices.insert(v);
+    }
+    typename boost::graph_traits<Graph>::edge_iterator ei, ei_end;
+    for (boost::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
+      uint const a = get(vertex_index, g, source(*ei, g));
+      uint const b = get(vertex_index, g, target(*ei, g));
+      uint const u = holders[a].size() <= holders[b].size() ? a : b;
+      uint const w = u == a ? b : a;
+      uint best = num_bags;
+      for (auto i : holders[u]) {
+        if (std::binary_search(bags[i].begin(), bags[i].end(), w)
+            and (best == num_bags or bags[i].size() < bags[best].size()))
+          best = i;
+      }
+      if (best == num_bags)
+        fail("edge " + std::to_string(a) + "-" + std::to_string(b) + " of the graph is in no bag");
+      nodes[best]->edges.push_back(std::make_pair(a, b));
+    }
+
+    for (std::size_t k = 1; k < order.size(); ++k)
+      nodes[parent[order[k]]]->children.push_back(nodes[order[k]]);
+    return nodes[0];
+  }
+
+  // Writes the tree decomposition of a graph with n vertices, bags
+  // numbered in pre-order from the root.
+  inline void write_pace(std::ostream& o, bag_ptr root, uint n)
+  {
+    flat_tree const t = flatten(root);
+    o << "s td " << t.bags.size() << " " << max_bag_size(root) << " " << n << "\n";
+    for (std::size_t i = 0; i < t.bags.size(); ++i) {
+      o << "b " << i + 1;
+      for (auto v : t.bags[i]->vertices)
+        o << " " << v + 1;
+      o << "\n";
+    }
+    for (std::size_t i = 1; i < t.bags.size(); ++i)
+      o << t.parent[i] + 1 << " " << i + 1 << "\n";
+  }
+}
+
+#endif
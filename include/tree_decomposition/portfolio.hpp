@@ -0,0 +1,137 @@
+/*
+ *  portfolio.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef PORTFOLIO_HPP
+#define PORTFOLIO_HPP
+
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/heuristics.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+#include "utility/thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace heuristics {
+
+  struct portfolio_result {
+    std::vector<unsigned int> order;
+    std::string heuristic;   // which heuristic found order
+    unsigned int round;      // 0 for the deterministic run
+    unsigned int tried;      // orders tried in total
+    double cost;             // tree_decomposition::estimated_work
+  };
+
+  // Runs every heuristic, then randomized restarts of each (random tie
+  // breaking, and other seeds for min_cost_order), on all the threads of
+  // pool until the given number of seconds has passed, and returns the
+  // order whose tree decomposition has the lowest estimated work. The
+  // first, deterministic, run of each heuristic always completes, even
+  // past the deadline. Jobs are numbered and ties go to the lowest
+  // number, so the outcome only depends on how many jobs were run.
+  // min_cost_order tries min_cost_iterations moves.
+  template<class Graph>
+  portfolio_result portfolio_order(Graph const& g, double seconds,
+    parallel::thread_pool* pool = nullptr, unsigned int seed = 0,
+    unsigned int min_cost_iterations = 2000)
+  {
+    enum { degree, fillin, local_degree, local_fillin, min_cost, num_heuristics };
+    static char const* const names[] = {
+      "degree", "fill-in", "local-degree", "local-fill-in", "min-cost"
+    };
+
+    typedef std::chrono::steady_clock clock;
+    auto const deadline = clock::now()
+      + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+
+    std::mutex m;
+    portfolio_result best;
+    best.cost = std::numeric_limits<double>::infinity();
+    best.tried = 0;
+    unsigned int best_job = 0;
+    std::atomic<unsigned int> next(0);
+
+    auto run = [&](unsigned int job, std::vector<unsigned int>& order) {
+      unsigned int const round = job / num_heuristics;
+      std::mt19937 rng(seed + job);
+      auto out = order.begin();
+      switch (job % num_heuristics) {
+      case degree:
+        if (round == 0)
+          greedy_degree_order(g, out);
+        else
+          greedy_degree_order(g, out, random_ties(rng));
+        break;
+      case fillin:
+        if (round == 0)
+          greedy_fillin_order(g, out);
+        else
+          greedy_fillin_order(g, out, random_ties(rng));
+        break;
+      case local_degree:
+        if (round == 0)
+          greedy_local_degree_order(g, out);
+        else
+          greedy_local_degree_order(g, out, random_ties(rng));
+        break;
+      case local_fillin:
+        if (round == 0)
+          greedy_local_fillin_order(g, out);
+        else
+          greedy_local_fillin_order(g, out, random_ties(rng));
+        break;
+      case min_cost:
+        min_cost_order(g, out, min_cost_iterations, 8, seed + round);
+        break;
+      }
+    };
+
+    auto worker = [&] {
+      std::vector<unsigned int> order(num_vertices(g));
+      while (true) {
+        unsigned int const job = next++;
+        if (job >= num_heuristics and clock::now() >= deadline)
+          return;
+        run(job, order);
+        double const cost = tree_decomposition::estimated_work(
+          tree_decomposition::build_tree_decomposition(order, g));
+
+        std::lock_guard<std::mutex> lock(m);
+        best.tried += 1;
+        if (cost < best.cost or (cost == best.cost and job < best_job)) {
+          best.order = order;
+          best.heuristic = names[job % num_heuristics];
+          best.round = job / num_heuristics;
+          best.cost = cost;
+          best_job = job;
+        }
+      }
+    };
+
+    if (pool) {
+      parallel::task_group group(*pool);
+      for (unsigned int i = 0; i < pool->size(); ++i)
+        group.run(worker);
+      group.wait();
+    } else {
+      worker();
+    }
+    return best;
+  }
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ *  simplify.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/tree_decomposition.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace tree_decomposition {
+
+  struct simplify_stats {
+    std::size_t bags_before, bags_after;
+    double work_before, work_after;  // estimated_work
+  };
+
+  // Contracts bags into their parents where this saves work in
+  // transfer. Each bag costs an empty state, a fusion and a chain of
+  // deletions, a waste when a bag b is the only child of its parent p
+  // and either b is contained in p (the table of p after fusing b is as
+  // large as that of b, so the edges of b can be joined there) or p is
+  // contained in b and has no edges (p only passes the table on).
+  // Chains of such bags, as at the top of a decomposition built from an
+  // elimination order, collapse into one bag. So do leaves with no
+  // edges contained in their parent, whose table is the empty state.
+  // Merges that would move the joins of an edge before some deletions
+  // are not done: deletions shrink the tables, so they would cost more
+  // even when the width does not grow. estimated_work bounds the tables
+  // by the size of their bags, so it charges the joins of b, and the
+  // fusions of its children, at the size of p when b goes into a larger
+  // p: a merge is only done if estimated_work does not grow, which it
+  // then never does overall. The width never grows. Returns the new
+  // root; the given tree is left alone.
+  inline bag_ptr simplify(bag_ptr root, simplify_stats* stats = nullptr)
+  {
+    flat_tree const t = flatten(root);
+    unsigned int const n = t.bags.size();
+
+    std::vector<std::vector<uint> > vertices(n), children(n);
+    std::vector<edge_list> edges(n);
+    std::vector<int> parent(t.parent);
+    for (uint i = 0; i < n; ++i) {
+      vertices[i].assign(t.bags[i]->vertices.begin(), t.bags[i]->vertices.end());
+      edges[i] = t.bags[i]->edges;
+      if (parent[i] >= 0)
+        children[parent[i]].push_back(i);
+    }
+
+    auto includes = [&](uint a, uint b) {
+      return std::includes(vertices[a].begin(), vertices[a].end(),
+        vertices[b].begin(), vertices[b].end());
+    };
+
+    auto common = [&](uint a, uint b) {
+      uint k = 0;
+      auto i = vertices[a].begin(), j = vertices[b].begin();
+      while (i != vertices[a].end() and j != vertices[b].end()) {
+        if (*i < *j) {
+          ++ i;
+        } else if (*j < *i) {
+          ++ j;
+        } else {
+          ++ k, ++ i, ++ j;
+        }
+      }
+      return k;
+    };
+
+    // estimated_work of b and p, and of fusing their children, as they
+    // are and with b contracted into p (taking the larger of the two as
+    // one contains the other): each bag pays its states per edge and
+    // per vertex deleted, and per state of each child's projection
+    auto gain = [&](uint b, uint p) {
+      auto const states = [](uint k) { return estimated_states(k); };
+      uint const kept_b = std::min(vertices[b].size(), vertices[p].size());
+      uint const kept_p = parent[p] < 0 ? 0 : common(p, parent[p]);
+      uint const size = std::max(vertices[b].size(), vertices[p].size());
+      double fused_b = 0, fused_p = 0;
+      for (auto c : children[b])
+        fused_b += states(common(c, b));
+      for (auto c : children[p]) {
+        if (c != b)
+          fused_p += states(common(c, p));
+      }
+      double const s_b = states(vertices[b].size()), s_p = states(vertices[p].size());
+      double const before = s_b * (edges[b].size() + vertices[b].size() - kept_b + fused_b)
+        + s_p * (states(kept_b) + edges[p].size() + vertices[p].size() - kept_p + fused_p);
+      double const after = states(size)
+        * (edges[b].size() + edges[p].size() + size - kept_p + fused_b + fused_p);
+      return before - after;
+    };
+
+    std::vector<bool> alive(n, true);
+    for (bool changed = true; changed; ) {
+      changed = false;
+      // children have larger indices than their parents, and merging
+      // keeps it so
+      for (uint b = n; b-- > 1; ) {
+        if (not alive[b])
+          continue;
+        uint const p = parent[b];
+        bool const only_child = children[p].size() == 1;
+        bool const useless_leaf = children[b].empty() and edges[b].empty();
+        if (includes(p, b) and (only_child or useless_leaf)) {
+          // p keeps its vertices, which include those of b
+        } else if (only_child and edges[p].empty() and includes(b, p)) {
+          // p takes the vertices of b
+        } else {
+          continue;
+        }
+        if (gain(b, p) < 0)
+          continue;
+        if (vertices[b].size() > vertices[p].size())
+          vertices[p].swap(vertices[b]);
+        edges[p].insert(edges[p].end(), edges[b].begin(), edges[b].end());
+        // the children of b take its place among those of p
+        auto& c = children[p];
+        auto it = c.erase(std::find(c.begin(), c.end(), b));
+        c.insert(it, children[b].begin(), children[b].end());
+        for (auto x : children[b])
+          parent[x] = p;
+        alive[b] = false;
+        changed = true;
+      }
+    }
+
+    std::vector<bag_ptr> bags(n);
+    std::size_t count = 0;
+    for (uint i = n; i-- > 0; ) {
+      if (not alive[i])
+        continue;
+      ++ count;
+      bags[i] = std::make_shared<bag>();
+      for (auto v : vertices[i])
+        bags[i]->vertices.insert(v);
+      bags[i]->edges.swap(edges[i]);
+      for (auto x : children[i])
+        bags[i]->children.push_back(bags[x]);
+    }
+
+    if (stats) {
+      stats->bags_before = n;
+      stats->bags_after = count;
+      stats->work_before = estimated_work(root);
+      stats->work_after = estimated_work(bags[0]);
+    }
+    return bags[0];
+  }
+}
+
+#endif
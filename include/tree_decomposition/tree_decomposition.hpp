@@ -18,13 +18,12 @@
 
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/properties.hpp>
-#include <boost/range/adaptors.hpp>
-#include <boost/range/algorithm/find_first_of.hpp>
-#include <boost/property_map/vector_property_map.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <algorithm>
 #include <iosfwd>
+#include <iterator>
+#include <memory>
 #include <vector>
 
 namespace {
@@ -54,113 +53,188 @@ namespace tree_decomposition {
     vertex_list vertices;
     edge_list edges;
     std::vector<bag_ptr> children;
+
+    bag() = default;
+    bag(bag const&) = default;
+
+    // the implicit destructor would recurse once per level and overflow
+    // the stack on deep (e.g. path) decompositions, so we unlink the
+    // bags which are going away first
+    ~bag()
+    {
+      std::vector<bag_ptr> stack;
+      stack.swap(children);
+      while (not stack.empty()) {
+        bag_ptr b = std::move(stack.back());
+        stack.pop_back();
+        if (b.use_count() == 1) {
+          for (auto& c : b->children)
+            stack.push_back(std::move(c));
+          b->children.clear();
+        }
+      }
+    }
   };
 
   using tree_decomposition = bag_ptr;
 
+  // Builds the tree decomposition given by a vertex elimination order.
+  // The bag of a vertex v holds v and its neighbours when v is
+  // eliminated, i.e. its neighbours later in the order once the earlier
+  // vertices have been eliminated, and the edges of the graph between v
+  // and those. Its parent is the bag of the first of them to be
+  // eliminated. Rather than eliminating vertices from a copy of the
+  // graph, the later neighbours of v are merged into those of its
+  // parent (which is enough, since they form a clique together with the
+  // parent), so the whole thing takes time proportional to the total
+  // size of the bags. Bags are computed in flat arrays, indexed by
+  // position in the order, and linked into a tree at the end.
   template<class Graph, class Range>
-  bag_ptr build_tree_decomposition(Range const& order, Graph g)
-  // please note that g is passed by copy
+  bag_ptr build_tree_decomposition(Range const& order, Graph const& g)
   {
     using namespace boost;
-    using vertex_descriptor = typename graph_traits<Graph>::vertex_descriptor;
-
-    std::vector<vertex_descriptor> vertices(num_vertices(g));
-    auto free_edge_index = num_edges(g);
-
-    // list (stable) vertex descriptors in the user-supplied order
-    uint i = 0;
-    for (auto vi : order)
-      vertices[i++] = vertex(vi, g);
-
-    // bags will be indexed by vertex indices
-    std::vector<bag_ptr> bags(num_vertices(g));
-
-    // each bag's parent index need also to be stored
-    std::map<uint, uint> parent;
-
-    // we need this map to differenciate between edges added during
-    // vertex eliminations from the ones originally present in the
-    // graph
-    auto filling_edge = make_vector_property_map<bool>(get(edge_index, g));
-
-    // iterate over these vertices in order
-    for (auto v : vertices) {
-      // this is the index
-      uint vi = get(vertex_index, g, v);
-
-      bags[vi] = std::make_shared<bag>();
-
-      // add to each vertex bag the vertex (index) vi
-      bags[vi]->vertices.insert(vi);
+    uint const n = num_vertices(g);
+    if (n == 0)
+      return std::make_shared<bag>();
+
+    std::vector<uint> position(n), vertex_at(n);
+    {
+      uint i = 0;
+      for (auto vi : order) {
+        vertex_at[i] = vi;
+        position[vi] = i++;
+      }
+    }
+    // vertex(i, g) is linear in i with listS
+    std::vector<typename graph_traits<Graph>::vertex_descriptor> descriptor(n);
+    for (auto v : as_range(vertices(g)))
+      descriptor[get(vertex_index, g, v)] = v;
+
+    // the edges of each vertex, in the order of its adjacency list, as
+    // positions
+    std::vector<std::size_t> edge_offset(n + 1, 0);
+    std::vector<uint> edge_target;
+    edge_target.reserve(2 * num_edges(g));
+    for (uint i = 0; i < n; ++i) {
+      auto const v = descriptor[vertex_at[i]];
+      bool second = false;
       for (auto e : as_range(out_edges(v, g))) {
-        // and add its neighbours
-        uint ui = get(vertex_index, g, target(e, g));
-        bags[vi]->vertices.insert(ui);
-        // add the edge to the bag if the edge is 'genuine'
-        if (not filling_edge[e])
-          bags[vi]->edges.push_back(std::make_pair(vi, ui));
+        uint const j = position[get(vertex_index, g, target(e, g))];
+        // a loop appears twice in the list, but is one edge
+        if (j == i and (second = not second) == false)
+          continue;
+        edge_target.push_back(j);
       }
+      edge_offset[i + 1] = edge_target.size();
+    }
 
-      // if we find the parent vertex index
-      if (out_degree(v, g) > 0) {
-        auto u = *find_first_of(vertices, adjacent_vertices(v, g));
-        parent[vi] = get(vertex_index, g, u);
+    // later neighbours, sorted, filled in as the elimination proceeds
+    std::vector<std::vector<uint> > later(n);
+    for (uint i = 0; i < n; ++i) {
+      for (std::size_t k = edge_offset[i]; k < edge_offset[i + 1]; ++k) {
+        if (edge_target[k] > i)
+          later[i].push_back(edge_target[k]);
       }
+      std::sort(later[i].begin(), later[i].end());
+      later[i].erase(std::unique(later[i].begin(), later[i].end()), later[i].end());
+    }
 
-      // eliminate vertex, marking filling edges as we add them
-      for (auto a : as_range(adjacent_vertices(v, g))) {
-        for (auto b : as_range(adjacent_vertices(v, g))) {
-          if (a != b and not edge(a, b, g).second) {
-            auto e = add_edge(a, b, free_edge_index++, g).first;
-            filling_edge[e] = true;
-          }
-        }
+    // bag i holds i and bag_vertex[bag_offset[i], bag_offset[i + 1])
+    std::vector<std::size_t> bag_offset(n + 1, 0);
+    std::vector<uint> bag_vertex;
+    std::vector<uint> parent(n, n);
+    std::vector<uint> merged;
+    for (uint i = 0; i < n; ++i) {
+      auto& l = later[i];
+      bag_vertex.insert(bag_vertex.end(), l.begin(), l.end());
+      bag_offset[i + 1] = bag_vertex.size();
+      if (not l.empty()) {
+        uint const p = l.front();
+        parent[i] = p;
+        merged.clear();
+        std::set_union(later[p].begin(), later[p].end(), l.begin() + 1, l.end(),
+          std::back_inserter(merged));
+        later[p].swap(merged);
       }
-      clear_vertex(v, g);
-      remove_vertex(v, g);
+      std::vector<uint>().swap(l);
     }
 
-    // ok, now we have a list of bags each with a parent index
-    // time to unroll the tree
+    std::vector<bag_ptr> bags(n);
+    std::vector<uint> vertices;
+    for (uint i = 0; i < n; ++i) {
+      uint const vi = vertex_at[i];
+      bags[i] = std::make_shared<bag>();
+      vertices.assign(1, vi);
+      for (std::size_t k = bag_offset[i]; k < bag_offset[i + 1]; ++k)
+        vertices.push_back(vertex_at[bag_vertex[k]]);
+      std::sort(vertices.begin(), vertices.end());
+      for (auto u : vertices)
+        bags[i]->vertices.insert(u);
+      for (std::size_t k = edge_offset[i]; k < edge_offset[i + 1]; ++k) {
+        if (edge_target[k] >= i)
+          bags[i]->edges.push_back(std::make_pair(vi, vertex_at[edge_target[k]]));
+      }
+    }
 
-    for (auto i : order | adaptors::reversed) {
-      if (parent.find(i) != parent.end())
+    // children are listed latest eliminated first; the trees of a
+    // graph that is not connected hang from an empty bag
+    std::vector<bag_ptr> roots;
+    for (uint i = n; i-- > 0; ) {
+      if (parent[i] < n)
         bags[parent[i]]->children.push_back(bags[i]);
+      else
+        roots.push_back(bags[i]);
     }
-
-    return bags[order.back()];
+    if (roots.size() == 1)
+      return roots.front();
+    auto root = std::make_shared<bag>();
+    root->children.swap(roots);
+    return root;
   }
 
   unsigned int max_bag_size(tree_decomposition t)
   {
-    auto max = t->vertices.size();
-    for (auto b : t->children) {
-      auto m = max_bag_size(b);
-      if (m > max)
-        max = m;
+    std::size_t max = 0;
+    std::vector<bag_ptr> stack{t};
+    while (not stack.empty()) {
+      auto b = stack.back();
+      stack.pop_back();
+      max = std::max(max, b->vertices.size());
+      stack.insert(stack.end(), b->children.begin(), b->children.end());
     }
     return max;
   }
 
   std::ostream& operator<<(std::ostream& o, tree_decomposition t)
   {
-    o << "( ";
-    for (auto v : t->vertices) {
-      o << v << " ";
-    }
-    if (not t->edges.empty()) {
-      o << "| ";
-      for (auto p : t->edges) {
-        o << p.first << "-" << p.second << " ";
+    // pre-order with an explicit stack, each entry is a bag and the
+    // index of its next child to print
+    std::vector<std::pair<bag_ptr, std::size_t> > stack{{t, 0}};
+    while (not stack.empty()) {
+      auto& x = stack.back();
+      auto const b = x.first;
+      if (x.second == 0) {
+        o << "( ";
+        for (auto v : b->vertices) {
+          o << v << " ";
+        }
+        if (not b->edges.empty()) {
+          o << "| ";
+          for (auto p : b->edges) {
+            o << p.first << "-" << p.second << " ";
+          }
+        }
+        o << ") ";
+        if (b->children.size())
+          o << "{ ";
+      }
+      if (x.second < b->children.size()) {
+        stack.emplace_back(b->children[x.second++], 0);
+      } else {
+        if (b->children.size())
+          o << "} ";
+        stack.pop_back();
       }
-    }
-    o << ") ";
-    if (t->children.size()) {
-      o << "{ ";
-      for (auto b : t->children)
-        o << b;
-      o << "} ";
     }
     return o;
   }
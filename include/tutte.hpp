@@ -15,7 +15,20 @@
 #define TUTTE_HPP
 
 #include "connectivity/connectivity.hpp"
-#include <boost/unordered/unordered_map.hpp>
+#include "preprocess.hpp"
+#include "utility/arena_map.hpp"
+#include "utility/arithmetic.hpp"
+#include "utility/counters.hpp"
+#include "utility/sharded_map.hpp"
+#include "utility/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 
 template<class Weight>
 class tutte
@@ -23,41 +36,357 @@ class tutte
   const Weight Q;
   const Weight v;
 
+  // operators whose work (number of entries, or pairs of entries for
+  // the fusion) reaches threshold_ are split across pool_
+  parallel::thread_pool* pool_;
+  std::size_t threshold_;
+
+  // if not zero, each operator keeps the tables it builds within about
+  // this many bytes, spilling them to files in spill_dir_
+  std::size_t memory_limit_;
+  std::string spill_dir_;
+
+  // if not null, the weights of the edges merged by preprocessing, with
+  // the (absent, present) weights of its terms
+  preprocess::edge_weights const* weights_;
+  std::vector<std::pair<Weight, Weight> > terms_;
+  std::vector<unsigned int> classes_;
+
 public:
   using weight_type = Weight ;
-  using table_type = boost::unordered_map<connectivity, weight_type>;
+  // tables are split in shards, each owning an arena holding its states
+  // and weights (see utility/sharded_map.hpp), so that dropping a table
+  // releases it all. Tables built serially have a single shard.
+  using table_type = parallel::sharded_map<connectivity, weight_type>;
 
   template<class T, class U>
-  tutte(T const& Q_, U const& v_) : Q(Q_), v(v_) {}
+  tutte(T const& Q_, U const& v_,
+    parallel::thread_pool* pool = nullptr, std::size_t threshold = 0,
+    std::size_t memory_limit = 0, std::string const& spill_dir = "/tmp",
+    preprocess::edge_weights const* weights = nullptr)
+    : Q(Q_), v(v_), pool_(pool), threshold_(threshold)
+    , memory_limit_(memory_limit), spill_dir_(spill_dir), weights_(weights)
+  {
+    if (weights_) {
+      terms_ = weights_->evaluate(Q, v);
+      classes_ = weights_->classes();
+    }
+    // subtrees running concurrently share the budget
+    if (pool_)
+      memory_limit_ /= pool_->size();
+  }
+
+private:
+  using shard_type = typename table_type::shard_type;
+  using value_type = typename table_type::value_type;
+
+  // Collects the contributions of an operator to its output. Either
+  // everything goes into a single shard, whose arena is then current,
+  // or contributions are routed to per-shard buffers, or to the shards
+  // of the output itself. In the latter cases keys are copied into the
+  // destination's arena, since temporaries live in a scratch arena.
+  // When routing to the output, its shards are spilled to disk as soon
+  // as they take more than limit bytes.
+  class emitter {
+    table_type& result_;
+    shard_type* out_;
+    std::vector<shard_type>* buffers_;
+    std::size_t limit_;
+    std::string const* dir_;
+    std::size_t count_;
+
+    // nodes compared to find c, for the counters
+    static std::size_t bucket_load(shard_type const& s, connectivity const& c)
+    {
+      return s.bucket_count() ? s.bucket_size(s.bucket(c)) : 0;
+    }
+
+    static void accumulate(Weight& w, Weight const& x, Weight const* f)
+    {
+      if (f)
+        addmul(w, x, *f);
+      else
+        w += x;
+    }
+
+    void route(connectivity const& c, Weight const& x, Weight const* f)
+    {
+      unsigned int const i = result_.shard_index(c);
+      auto& b = buffers_ ? (*buffers_)[i] : result_.shard(i);
+      TUTTE_COUNT(probes, bucket_load(b, c));
+      {
+        memory::arena::scope scope(b.get_arena());
+        accumulate(b[c], x, f);
+      }
+      // checking every so often is enough, memory grows slowly
+      if (limit_ and ++ count_ % 4096 == 0 and result_.bytes() > limit_) {
+        for (unsigned int k = 0; k < result_.num_shards(); ++k)
+          result_.spill(k, *dir_);
+      }
+    }
+
+  public:
+    emitter(table_type& result, shard_type& out)
+      : result_(result), out_(&out), buffers_(nullptr), limit_(0) {}
+
+    emitter(table_type& result, std::vector<shard_type>& buffers)
+      : result_(result), out_(nullptr), buffers_(&buffers), limit_(0) {}
+
+    emitter(table_type& result, std::size_t limit, std::string const& dir)
+      : result_(result), out_(nullptr), buffers_(nullptr)
+      , limit_(limit), dir_(&dir), count_(0) {}
+
+    // adds x (times f) to the weight of c
+    void operator()(connectivity&& c, Weight const& x, Weight const* f = nullptr)
+    {
+      TUTTE_COUNT(emits, 1);
+      if (out_) {
+        TUTTE_COUNT(probes, bucket_load(*out_, c));
+        accumulate((*out_)[std::move(c)], x, f);
+      } else {
+        route(c, x, f);
+      }
+    }
+
+    void operator()(connectivity const& c, Weight const& x, Weight const* f = nullptr)
+    {
+      TUTTE_COUNT(emits, 1);
+      if (out_) {
+        TUTTE_COUNT(probes, bucket_load(*out_, c));
+        accumulate((*out_)[c], x, f);
+      } else {
+        route(c, x, f);
+      }
+    }
+  };
+
+  // builds a new table calling f(e, emit) for each entry e of t
+  template<class F>
+  table_type transform(table_type const& t, std::size_t work, F f) const
+  {
+    if (memory_limit_) {
+      return bounded_transform(t, work, [&](shard_type const& s, emitter& emit) {
+        for (auto const& e : s)
+          f(e, emit);
+      });
+    }
+    if (pool_ and pool_->size() > 1 and work >= threshold_)
+      return parallel_transform(t, f);
+
+    table_type tmp_table;
+    auto& out = tmp_table.shard(0);
+    memory::arena::scope scope(out.get_arena());
+    emitter emit(tmp_table, out);
+    for (auto const& e : t)
+      f(e, emit);
+    return tmp_table;
+  }
+
+  // The input is cut in chunks of buckets, taken in turn by one task
+  // per thread. Each task routes its output to its own per-shard
+  // buffers, then one task per shard merges that shard's buffers. No
+  // two threads ever touch the same map, so there is no locking besides
+  // the pool's own, and there are n buffers per shard, n being the
+  // number of threads, whatever the number of chunks.
+  template<class F>
+  table_type parallel_transform(table_type const& t, F f) const
+  {
+    unsigned int const n = pool_->size();
+    unsigned int num_shards = 1;
+    while (num_shards < n)
+      num_shards <<= 1;
+    table_type tmp_table(num_shards);
+
+    struct chunk {
+      shard_type const* s;
+      std::size_t first, last;
+    };
+    std::size_t buckets = 0;
+    for (unsigned int i = 0; i < t.num_shards(); ++i)
+      buckets += t.shard(i).bucket_count();
+    std::size_t const step = std::max<std::size_t>(1, buckets / (4 * n));
+    std::vector<chunk> chunks;
+    for (unsigned int i = 0; i < t.num_shards(); ++i) {
+      auto const& s = t.shard(i);
+      for (std::size_t b = 0; b < s.bucket_count(); b += step)
+        chunks.push_back({&s, b, std::min(b + step, s.bucket_count())});
+    }
+
+    if (chunks.empty())
+      return tmp_table;
+
+    unsigned int const tasks = std::min<std::size_t>(n, chunks.size());
+    std::vector<std::vector<shard_type> > buffers(tasks);
+    std::atomic<std::size_t> next(0);
+    parallel::task_group group(*pool_);
+    TUTTE_COUNTER_SAVE(counter_op);
+    for (unsigned int k = 0; k < tasks; ++k) {
+      group.run([&, k] {
+        TUTTE_COUNTER_RESTORE(counter_op);
+        buffers[k].resize(num_shards);
+        memory::arena scratch;
+        memory::arena::scope scope(scratch);
+        emitter emit(tmp_table, buffers[k]);
+        for (std::size_t j; (j = next++) < chunks.size(); ) {
+          chunk const& c = chunks[j];
+          for (std::size_t b = c.first; b < c.last; ++b) {
+            for (auto it = c.s->begin(b); it != c.s->end(b); ++it)
+              f(*it, emit);
+          }
+        }
+      });
+    }
+    group.wait();
+
+    for (unsigned int i = 0; i < num_shards; ++i) {
+      group.run([&, i] {
+        // take over the largest buffer, add the others to it
+        std::size_t largest = 0;
+        for (std::size_t k = 1; k < buffers.size(); ++k) {
+          if (buffers[k][i].size() > buffers[largest][i].size())
+            largest = k;
+        }
+        auto& out = tmp_table.shard(i);
+        out.swap(buffers[largest][i]);
+        memory::arena::scope scope(out.get_arena());
+        for (auto& b : buffers) {
+          if (b[i].empty())
+            continue;
+          for (auto const& e : b[i])
+            out[e.first] += e.second;
+          shard_type().swap(b[i]);
+        }
+      });
+    }
+    group.wait();
+    return tmp_table;
+  }
+
+  // Builds a new table calling f(s, emit) for each shard s of t, loading
+  // spilled shards one at a time. The output has enough shards for
+  // each of them to fit in the budget, assuming it is about as large as
+  // the work times the size of an entry of t. Half the budget goes to
+  // the output while it is built, the other half to the input; at the
+  // end spilled shards are merged one at a time and kept in memory as
+  // long as they fit in the output's half.
+  template<class F>
+  table_type bounded_transform(table_type const& t, std::size_t work, F f) const
+  {
+    std::size_t const limit = memory_limit_ / 2;
+    double const entry_bytes =
+      double(t.bytes() + t.spilled_bytes()) / std::max<std::size_t>(1, t.size());
+    double const shard_bytes = std::max(1.0, limit / 4.0);
+    unsigned int num_shards = 1;
+    while (num_shards < max_shards and num_shards * shard_bytes < work * entry_bytes)
+      num_shards <<= 1;
+    table_type tmp_table(num_shards);
+
+    {
+      memory::arena scratch;
+      memory::arena::scope scope(scratch);
+      emitter emit(tmp_table, limit, spill_dir_);
+      t.for_each_shard([&](shard_type const& s) { f(s, emit); });
+    }
+
+    // tables expected to fit in a single shard are not left on disk
+    std::size_t resident = 0;
+    for (unsigned int i = 0; i < num_shards; ++i) {
+      tmp_table.consolidate(i);
+      std::size_t const bytes = tmp_table.shard(i).get_arena().bytes_reserved();
+      if (num_shards == 1 or resident + bytes <= limit)
+        resident += bytes;
+      else
+        tmp_table.spill(i, spill_dir_);
+    }
+    // nor is a single entry, transfer reads the final weight directly
+    if (tmp_table.size() == 1) {
+      for (unsigned int i = 0; i < num_shards; ++i)
+        tmp_table.consolidate(i);
+    }
+    return tmp_table;
+  }
+
+  static const unsigned int max_shards = 1 << 12;
+
+  // counts an operator call, its input and its output
+  static void count(std::size_t input_entries, table_type const& out)
+  {
+#ifdef TUTTE_COUNTERS
+    TUTTE_COUNT(calls, 1);
+    TUTTE_COUNT(input_entries, input_entries);
+    TUTTE_COUNT(output_entries, out.size());
+    for (unsigned int i = 0; i < out.num_shards(); ++i) {
+      TUTTE_COUNT(buckets, out.shard(i).bucket_count());
+      TUTTE_COUNT(allocations, out.shard(i).get_arena().num_allocations());
+    }
+#endif
+  }
+
+public:
+  // identifies the operators, for checkpoints; with modular weights -1
+  // spells out the modulus
+  std::string signature() const
+  {
+    std::ostringstream o;
+    o << typeid(Weight).name() << " Q = " << Q << " v = " << v
+      << " -1 = " << Weight(-1);
+    if (weights_ and not weights_->empty())
+      o << " weights = " << std::hex << weights_->digest();
+    return o.str();
+  }
+
+  // edges of the same class weigh the same
+  unsigned int edge_class(std::pair<unsigned int, unsigned int> const& edge) const
+  {
+    return weights_ ? classes_[weights_->find(edge.first, edge.second)] : 0;
+  }
 
   table_type empty_state(unsigned int size) const
   {
     table_type tmp_table;
-    tmp_table[connectivity(size)] = Weight(1);
+    auto& out = tmp_table.shard(0);
+    memory::arena::scope scope(out.get_arena());
+    out[connectivity(size)] = Weight(1);
     return tmp_table;
   }
 
+  // joins the edge of the graph between the vertices at positions i
+  // and j of the bag
   table_type
-  join_operator(unsigned int i, unsigned int j, table_type const& t) const
+  join_operator(unsigned int i, unsigned int j, table_type const& t,
+    std::pair<unsigned int, unsigned int> const& edge) const
   {
-    table_type tmp_table;
-    for (auto const & e : t) {
-      tmp_table[e.first] += e.second;
-      tmp_table[connectivity(e.first).connect(i, j).canonicalize()]
-        += e.second * v;
+    TUTTE_COUNTER_SCOPE(join);
+    Weight const* absent = nullptr;
+    Weight const* present = &v;
+    if (weights_) {
+      unsigned int const k = weights_->find(edge.first, edge.second);
+      if (k != preprocess::edge_weights::plain) {
+        absent = &terms_[k].first;
+        present = &terms_[k].second;
+      }
     }
-    return tmp_table;
+    auto result = transform(t, t.size(), [&](value_type const& e, emitter& emit) {
+      TUTTE_COUNT(canonicalize, 1);
+      emit(e.first, e.second, absent);
+      emit(std::move(connectivity(e.first).connect(i, j).canonicalize()),
+        e.second, present);
+    });
+    count(t.size(), result);
+    return result;
   }
 
   table_type
   delete_operator(unsigned int i, table_type const& t) const
   {
-    table_type tmp_table;
-    for (auto const& e : t) {
-      tmp_table[connectivity(e.first).delete_node(i).canonicalize()]
-        += (e.first.singleton(i) ? (e.second * Q) : e.second);
-    }
-    return tmp_table;
+    TUTTE_COUNTER_SCOPE(deletion);
+    auto result = transform(t, t.size(), [&](value_type const& e, emitter& emit) {
+      TUTTE_COUNT(canonicalize, 1);
+      emit(std::move(connectivity(e.first).delete_node(i).canonicalize()),
+        e.second, e.first.singleton(i) ? &Q : nullptr);
+    });
+    count(t.size(), result);
+    return result;
   }
 
   template<class Mapping>
@@ -66,17 +395,52 @@ public:
     table_type const& A_table,
     table_type const& B_table) const
   {
-    table_type tmp_table;
-    for (auto const & eA : A_table) {
-      for (auto const & eB : B_table) {
-        connectivity c = eB.first;
-        eA.first.decompose([&](unsigned int i, unsigned int j) {
-          c.connect(A_to_B[i], A_to_B[j]);
+    TUTTE_COUNTER_SCOPE(fusion);
+    auto fuse = [&](value_type const& eA, value_type const& eB, emitter& emit) {
+      TUTTE_COUNT(pairs, 1);
+      TUTTE_COUNT(canonicalize, 1);
+      connectivity c = eB.first;
+      eA.first.decompose([&](unsigned int i, unsigned int j) {
+        c.connect(A_to_B[i], A_to_B[j]);
+      });
+      emit(std::move(c.canonicalize()), eA.second, &eB.second);
+    };
+
+    // split the work over the larger of the two tables
+    auto const work = A_table.size() * B_table.size();
+
+    // with a memory budget, both tables may have spilled shards: join
+    // each shard of the larger with each shard of the smaller
+    table_type result;
+    if (memory_limit_) {
+      bool const A_outer = A_table.size() >= B_table.size();
+      table_type const& outer = A_outer ? A_table : B_table;
+      table_type const& inner = A_outer ? B_table : A_table;
+      result = bounded_transform(outer, work, [&](shard_type const& s, emitter& emit) {
+        inner.for_each_shard([&](shard_type const& s_inner) {
+          for (auto const& e : s) {
+            for (auto const& e_inner : s_inner) {
+              if (A_outer)
+                fuse(e, e_inner, emit);
+              else
+                fuse(e_inner, e, emit);
+            }
+          }
         });
-        tmp_table[c.canonicalize()] += eA.second * eB.second;
-      }
+      });
+    } else if (A_table.size() >= B_table.size()) {
+      result = transform(A_table, work, [&](value_type const& eA, emitter& emit) {
+        for (auto const& eB : B_table)
+          fuse(eA, eB, emit);
+      });
+    } else {
+      result = transform(B_table, work, [&](value_type const& eB, emitter& emit) {
+        for (auto const& eA : A_table)
+          fuse(eA, eB, emit);
+      });
     }
-    return tmp_table;
+    count(A_table.size() + B_table.size(), result);
+    return result;
   }
 };
 #endif
@@ -13,6 +13,8 @@
 #ifndef ZP_HPP
 #define ZP_HPP
 
+#include "utility/binary_io.hpp"
+
 #include <boost/cstdint.hpp>
 #include <boost/operators.hpp>
 #include <boost/type_traits/is_integral.hpp>
@@ -119,6 +121,16 @@ namespace modular {
       return rep_ == rhs.rep_;
     }
 
+    friend void write_binary(std::FILE* f, Zp const& x)
+    {
+      binary_io::write_binary(f, x.rep_);
+    }
+
+    friend void read_binary(std::FILE* f, Zp& x)
+    {
+      binary_io::read_binary(f, x.rep_);
+    }
+
     friend std::ostream& operator<<(std::ostream& o, Zp const& x)
     {
       return o << x.rep_ << " (" << M << ")";
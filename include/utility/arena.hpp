@@ -0,0 +1,284 @@
+/*
+ *  arena.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace memory {
+
+  // An arena hands out small blocks carved from large chunks and keeps
+  // freed blocks on per size-class free lists. Everything allocated
+  // through it is released at once when the arena is reset or
+  // destroyed.
+  //
+  // Every block (arena or heap) is preceded by a header recording its
+  // owner, so that it can be released correctly whatever arena is
+  // current at that time. Blocks too large for the arena come from the
+  // heap but are still accounted to the arena current at allocation,
+  // so they must not outlive it either. An arena must only be used by
+  // one thread at a time.
+
+  class arena {
+  public:
+    struct header {
+      arena* owner;
+      boost::uint32_t size_class;
+      boost::uint32_t unused;
+    };
+
+    static const std::size_t granularity = 16;
+    static const std::size_t num_classes = 64;
+    static const std::size_t max_block = granularity * num_classes;
+    // size class of blocks from the heap, their size is in 'unused'
+    static const boost::uint32_t heap_block = ~boost::uint32_t(0);
+
+  private:
+    static_assert(sizeof(header) == granularity, "header size");
+
+    struct free_block { free_block* next; };
+
+    std::vector<char*> chunks_;
+    char* cursor_;
+    char* limit_;
+    std::size_t next_chunk_;
+    free_block* free_[num_classes];
+    std::size_t bytes_in_use_;
+    std::size_t bytes_reserved_;
+    std::size_t num_allocations_;
+    bool releasing_;
+
+    arena(arena const&);
+    arena& operator=(arena const&);
+
+    void new_chunk(std::size_t n)
+    {
+      std::size_t size = std::max(next_chunk_, n);
+      char* c = static_cast<char*>(std::malloc(size));
+      if (not c)
+        throw std::bad_alloc();
+      chunks_.push_back(c);
+      cursor_ = c;
+      limit_ = c + size;
+      bytes_reserved_ += size;
+      next_chunk_ = std::min<std::size_t>(2 * next_chunk_, 1 << 20);
+    }
+
+  public:
+    arena()
+      : cursor_(0), limit_(0), next_chunk_(1 << 12)
+      , bytes_in_use_(0), bytes_reserved_(0), num_allocations_(0)
+      , releasing_(false)
+    {
+      std::fill(free_, free_ + num_classes, nullptr);
+    }
+
+    ~arena()
+    {
+      for (auto c : chunks_)
+        std::free(c);
+    }
+
+    // returns a block of at least n bytes (n <= max_block)
+    void* allocate(std::size_t n)
+    {
+      std::size_t k = n ? (n - 1) / granularity : 0;
+      ++ num_allocations_;
+      bytes_in_use_ += (k + 1) * granularity;
+      if (free_[k]) {
+        free_block* b = free_[k];
+        free_[k] = b->next;
+        return b;
+      }
+      std::size_t size = sizeof(header) + (k + 1) * granularity;
+      if (cursor_ + size > limit_)
+        new_chunk(size);
+      header* h = reinterpret_cast<header*>(cursor_);
+      cursor_ += size;
+      h->owner = this;
+      h->size_class = k;
+      return h + 1;
+    }
+
+    // accounts a heap block of n bytes to this arena
+    void add_heap_block(std::size_t n)
+    {
+      ++ num_allocations_;
+      bytes_in_use_ += n;
+      bytes_reserved_ += n;
+    }
+
+    void remove_heap_block(std::size_t n)
+    {
+      bytes_in_use_ -= n;
+      bytes_reserved_ -= n;
+    }
+
+    void deallocate(void* p, header const* h)
+    {
+      if (releasing_)
+        return;
+      bytes_in_use_ -= (h->size_class + 1) * granularity;
+      free_block* b = static_cast<free_block*>(p);
+      b->next = free_[h->size_class];
+      free_[h->size_class] = b;
+    }
+
+    static std::size_t capacity(header const* h)
+    {
+      return (h->size_class + 1) * granularity;
+    }
+
+    // from now on deallocations are no-ops, the owner is about to drop
+    // the whole arena
+    void release()
+    {
+      releasing_ = true;
+    }
+
+    // drops every block at once, heap blocks must have been freed
+    void reset()
+    {
+      for (auto c : chunks_)
+        std::free(c);
+      chunks_.clear();
+      cursor_ = limit_ = 0;
+      std::fill(free_, free_ + num_classes, nullptr);
+      bytes_in_use_ = 0;
+      bytes_reserved_ = 0;
+      releasing_ = false;
+    }
+
+    std::size_t bytes_in_use() const { return bytes_in_use_; }
+    std::size_t bytes_reserved() const { return bytes_reserved_; }
+    std::size_t num_allocations() const { return num_allocations_; }
+
+    // the arena new allocations are served from, on this thread
+    static arena*& current()
+    {
+      static thread_local arena* a = nullptr;
+      return a;
+    }
+
+    // makes an arena current for the lifetime of the scope object
+    class scope {
+      arena* previous_;
+    public:
+      explicit scope(arena& a) : previous_(current()) { current() = &a; }
+      ~scope() { current() = previous_; }
+    };
+  };
+
+  //////////////////////////////////////////////////////////////////////
+
+  namespace detail {
+    inline void set_heap_block(arena::header* h, arena* a, std::size_t n)
+    {
+      // blocks larger than 4 GB are not accounted
+      h->owner = n >> 32 ? nullptr : a;
+      h->size_class = arena::heap_block;
+      h->unused = n;
+      if (h->owner)
+        a->add_heap_block(n);
+    }
+  }
+
+  inline void* allocate(std::size_t n)
+  {
+    arena* a = arena::current();
+    if (a and n <= arena::max_block)
+      return a->allocate(n);
+    arena::header* h = static_cast<arena::header*>(
+      std::malloc(sizeof(arena::header) + n));
+    if (not h)
+      throw std::bad_alloc();
+    detail::set_heap_block(h, a, n);
+    return h + 1;
+  }
+
+  inline void deallocate(void* p)
+  {
+    if (not p)
+      return;
+    arena::header* h = static_cast<arena::header*>(p) - 1;
+    if (h->size_class == arena::heap_block) {
+      if (h->owner)
+        h->owner->remove_heap_block(h->unused);
+      std::free(h);
+    } else {
+      h->owner->deallocate(p, h);
+    }
+  }
+
+  // blocks stay with the arena (or heap) they were first allocated from
+  inline void* reallocate(void* p, std::size_t old_size, std::size_t n)
+  {
+    if (not p)
+      return allocate(n);
+    arena::header* h = static_cast<arena::header*>(p) - 1;
+    if (h->size_class == arena::heap_block) {
+      arena* a = h->owner;
+      if (a)
+        a->remove_heap_block(h->unused);
+      h = static_cast<arena::header*>(
+        std::realloc(h, sizeof(arena::header) + n));
+      if (not h)
+        throw std::bad_alloc();
+      detail::set_heap_block(h, a, n);
+      return h + 1;
+    }
+    if (n <= arena::capacity(h))
+      return p;
+    arena::scope s(*h->owner);
+    void* q = allocate(n);
+    std::memcpy(q, p, std::min(old_size, n));
+    deallocate(p);
+    return q;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  // stateless allocator drawing from the current arena
+  template<class T>
+  struct arena_allocator {
+    typedef T value_type;
+
+    arena_allocator() {}
+    template<class U>
+    arena_allocator(arena_allocator<U> const&) {}
+
+    T* allocate(std::size_t n)
+    {
+      return static_cast<T*>(memory::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+      memory::deallocate(p);
+    }
+
+    template<class U>
+    bool operator==(arena_allocator<U> const&) const { return true; }
+    template<class U>
+    bool operator!=(arena_allocator<U> const&) const { return false; }
+  };
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ *  arena_map.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef ARENA_MAP_HPP
+#define ARENA_MAP_HPP
+
+#include "utility/arena.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered/unordered_map.hpp>
+
+#include <memory>
+#include <utility>
+
+namespace memory {
+  namespace detail {
+    // a base class, so that the arena is constructed before and
+    // destroyed after the map that lives in it
+    struct arena_holder {
+      std::unique_ptr<arena> arena_;
+      arena_holder() : arena_(new arena) {}
+    };
+  }
+
+  // An unordered_map whose nodes, keys and values all live in an arena
+  // owned by the map itself. Whatever is allocated while the map's
+  // arena is current is dropped together with the map.
+  template<class Key, class T, class Hash = boost::hash<Key>,
+           class Pred = std::equal_to<Key> >
+  class arena_map
+    : detail::arena_holder
+    , public boost::unordered_map<Key, T, Hash, Pred,
+        arena_allocator<std::pair<const Key, T> > >
+  {
+    typedef boost::unordered_map<Key, T, Hash, Pred,
+      arena_allocator<std::pair<const Key, T> > > base;
+
+  public:
+    arena_map() {}
+
+    arena_map(arena_map const& o)
+    {
+      arena::scope s(*arena_);
+      base::operator=(o);
+    }
+
+    arena_map(arena_map&& o)
+    {
+      swap(o);
+    }
+
+    ~arena_map()
+    {
+      arena_->release();
+    }
+
+    arena_map& operator=(arena_map const& o)
+    {
+      arena_map tmp(o);
+      swap(tmp);
+      return *this;
+    }
+
+    // the old content is dropped together with its arena, when o dies
+    arena_map& operator=(arena_map&& o)
+    {
+      swap(o);
+      return *this;
+    }
+
+    void swap(arena_map& o)
+    {
+      base::swap(o);
+      arena_.swap(o.arena_);
+    }
+
+    memory::arena& get_arena() const
+    {
+      return *arena_;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *  arithmetic.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef ARITHMETIC_HPP
+#define ARITHMETIC_HPP
+
+// Generic fused multiply-accumulate. Weight types that can do better
+// (gmp::mpz_int, polynomial_two) provide their own overloads, which are
+// found by argument dependent lookup and preferred over these templates.
+
+template<class T>
+inline void addmul(T& r, T const& a, T const& b)
+{
+  r += a * b;
+}
+
+template<class T>
+inline void submul(T& r, T const& a, T const& b)
+{
+  r -= a * b;
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *  binary_io.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef BINARY_IO_HPP
+#define BINARY_IO_HPP
+
+#include <cstdio>
+#include <stdexcept>
+#include <type_traits>
+
+// Raw binary (de)serialization, used to spill tables to disk. The
+// format is the in-memory representation, files are only ever read
+// back by the process that wrote them. Class types provide their own
+// write_binary/read_binary overloads, found by ADL.
+
+namespace binary_io {
+
+  inline void write_raw(std::FILE* f, void const* p, std::size_t n)
+  {
+    if (n and std::fwrite(p, 1, n, f) != n)
+      throw std::runtime_error("binary_io: write failed");
+  }
+
+  inline void read_raw(std::FILE* f, void* p, std::size_t n)
+  {
+    if (n and std::fread(p, 1, n, f) != n)
+      throw std::runtime_error("binary_io: read failed");
+  }
+
+  template<class T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  write_binary(std::FILE* f, T const& x)
+  {
+    write_raw(f, &x, sizeof(T));
+  }
+
+  template<class T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  read_binary(std::FILE* f, T& x)
+  {
+    read_raw(f, &x, sizeof(T));
+  }
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ *  counters.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+// Event counters for the hot paths of the table operators, compiled in
+// only with -DTUTTE_COUNTERS (cmake -DTUTTE_COUNTERS=ON). Otherwise all
+// the macros below expand to nothing and their arguments are not
+// evaluated.
+//
+// Each thread counts into its own block with plain increments; blocks
+// are registered once per thread and summed when the program exits.
+// Events are attributed to the operator set by TUTTE_COUNTER_SCOPE on
+// the counting thread.
+
+#ifdef TUTTE_COUNTERS
+
+#include <boost/cstdint.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace counters {
+
+  enum operation { join, deletion, fusion, other, num_operations };
+
+  enum counter {
+    calls,           // operator calls
+    input_entries,   // entries of the input tables
+    pairs,           // pairs of entries considered by fusions
+    canonicalize,    // states canonicalized
+    emits,           // contributions to the output
+    probes,          // nodes in the bucket hit by each contribution
+    output_entries,  // entries of the output tables
+    buckets,         // buckets of the output tables
+    allocations,     // arena allocations of the output tables
+    num_counters
+  };
+
+  inline char const* name(operation op)
+  {
+    static char const* names[] = { "join", "delete", "fusion", "other" };
+    return names[op];
+  }
+
+  inline char const* name(counter c)
+  {
+    static char const* names[] = {
+      "calls", "input_entries", "pairs", "canonicalize", "emits",
+      "probes", "output_entries", "buckets", "allocations"
+    };
+    return names[c];
+  }
+
+  struct block {
+    boost::uint64_t c[num_operations][num_counters];
+    block() : c() {}
+  };
+
+  class registry {
+    std::mutex m_;
+    std::vector<std::unique_ptr<block> > blocks_;
+
+    registry() {}
+
+  public:
+    static registry& get()
+    {
+      static registry r;
+      return r;
+    }
+
+    block* add()
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      blocks_.emplace_back(new block);
+      return blocks_.back().get();
+    }
+
+    // at exit all threads are gone
+    ~registry()
+    {
+      block total;
+      for (auto const& b : blocks_) {
+        for (int op = 0; op < num_operations; ++op)
+          for (int k = 0; k < num_counters; ++k)
+            total.c[op][k] += b->c[op][k];
+      }
+
+      std::fprintf(stderr, "Counters (%u threads):\n", unsigned(blocks_.size()));
+      for (int op = 0; op < num_operations; ++op) {
+        auto const& c = total.c[op];
+        if (c[calls] == 0 and c[emits] == 0)
+          continue;
+        std::fprintf(stderr, "  %s:", name(operation(op)));
+        for (int k = 0; k < num_counters; ++k)
+          std::fprintf(stderr, " %s=%llu", name(counter(k)), (unsigned long long) c[k]);
+        std::fprintf(stderr, "\n");
+        auto ratio = [](boost::uint64_t a, boost::uint64_t b) {
+          return b ? double(a) / b : 0.0;
+        };
+        std::fprintf(stderr,
+          "  %s: probes/emit=%.3f emits/entry=%.3f load_factor=%.3f allocations/entry=%.3f\n",
+          name(operation(op)), ratio(c[probes], c[emits]),
+          ratio(c[emits], c[output_entries]), ratio(c[output_entries], c[buckets]),
+          ratio(c[allocations], c[output_entries]));
+      }
+    }
+  };
+
+  inline block& local()
+  {
+    static thread_local block* b = registry::get().add();
+    return *b;
+  }
+
+  inline operation& current()
+  {
+    static thread_local operation op = other;
+    return op;
+  }
+
+  inline void add(counter k, boost::uint64_t n)
+  {
+    local().c[current()][k] += n;
+  }
+
+  // attributes events on this thread to op, for the lifetime of the scope
+  class scope {
+    operation previous_;
+  public:
+    explicit scope(operation op) : previous_(current()) { current() = op; }
+    ~scope() { current() = previous_; }
+  };
+}
+
+#define TUTTE_COUNT(k, n) ::counters::add(::counters::k, (n))
+#define TUTTE_COUNTER_SCOPE(op) ::counters::scope tutte_counter_scope_(::counters::op)
+// carries the current operator over to tasks run on other threads
+#define TUTTE_COUNTER_SAVE(var) auto const var = ::counters::current()
+#define TUTTE_COUNTER_RESTORE(var) ::counters::scope tutte_counter_scope_(var)
+
+#else
+
+#define TUTTE_COUNT(k, n) ((void) 0)
+#define TUTTE_COUNTER_SCOPE(op) ((void) 0)
+#define TUTTE_COUNTER_SAVE(var) ((void) 0)
+#define TUTTE_COUNTER_RESTORE(var) ((void) 0)
+
+#endif
+
+#endif
@@ -14,12 +14,41 @@
 #ifndef GMP_HPP
 #define GMP_HPP
 
+#include "utility/arena.hpp"
+#include "utility/binary_io.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <iosfwd>
 #include <type_traits>
 
 namespace gmp {
 	#include "gmp.h"
 
+	// Route every GMP allocation through memory::allocate, so that limbs
+	// of numbers created while an arena is current live in that arena.
+	// Must be called before any mpz_int is created.
+
+	namespace detail {
+		inline void* allocate(size_t n) {
+			return memory::allocate(n);
+		}
+
+		inline void* reallocate(void* p, size_t old_size, size_t n) {
+			return memory::reallocate(p, old_size, n);
+		}
+
+		inline void deallocate(void* p, size_t) {
+			memory::deallocate(p);
+		}
+	}
+
+	inline void use_arena_allocator() {
+		mp_set_memory_functions(detail::allocate, detail::reallocate,
+			detail::deallocate);
+	}
+
 	class mpz_int {
 		mpz_t m_data;
 	public:
@@ -33,10 +62,25 @@ namespace gmp {
 		}
 
 		mpz_int& operator=(mpz_int const& o) {
-			mpz_init_set(m_data, o.m_data);
+			mpz_set(m_data, o.m_data);
 			return *this;
 		}
 
+		// moving just swaps the limbs, mpz_init does not allocate
+		mpz_int(mpz_int&& o) {
+			mpz_init(m_data);
+			mpz_swap(m_data, o.m_data);
+		}
+
+		mpz_int& operator=(mpz_int&& o) {
+			mpz_swap(m_data, o.m_data);
+			return *this;
+		}
+
+		void swap(mpz_int& o) {
+			mpz_swap(m_data, o.m_data);
+		}
+
 		// 5.3 Combined Initialization and Assignment Functions
 
 		template<typename T>
@@ -190,6 +234,35 @@ namespace gmp {
 			mpz_fdiv_q_2exp(m_data, m_data, rhs);
 			return *this;
 		}
+
+		// fused multiply-accumulate, r += a * b and r -= a * b without
+		// allocating a temporary for the product
+
+		friend void addmul(mpz_int& r, mpz_int const& a, mpz_int const& b) {
+			mpz_addmul(r.m_data, a.m_data, b.m_data);
+		}
+
+		friend void submul(mpz_int& r, mpz_int const& a, mpz_int const& b) {
+			mpz_submul(r.m_data, a.m_data, b.m_data);
+		}
+
+		// raw limbs, the sign goes with the size
+
+		friend void write_binary(std::FILE* f, mpz_int const& x) {
+			int32_t const size = x.m_data->_mp_size;
+			binary_io::write_binary(f, size);
+			binary_io::write_raw(f, mpz_limbs_read(x.m_data),
+				std::abs(size) * sizeof(mp_limb_t));
+		}
+
+		friend void read_binary(std::FILE* f, mpz_int& x) {
+			int32_t size;
+			binary_io::read_binary(f, size);
+			mp_size_t const n = std::abs(size);
+			binary_io::read_raw(f, mpz_limbs_write(x.m_data, std::max<mp_size_t>(n, 1)),
+				n * sizeof(mp_limb_t));
+			mpz_limbs_finish(x.m_data, size);
+		}
 	
 		// 5.6 Division Functions
 
@@ -269,6 +342,10 @@ namespace gmp {
 		}
 	};
 
+	inline void swap(mpz_int& a, mpz_int& b) {
+		a.swap(b);
+	}
+
 	// stolen from boost.multiprecision
 	std::ostream& operator<<(std::ostream& o, mpz_int const& rhs)
 	{
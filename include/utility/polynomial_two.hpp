@@ -14,8 +14,15 @@
 #ifndef POLYNOMIAL_TWO_HPP
 #define POLYNOMIAL_TWO_HPP
 
+#include "utility/arena.hpp"
+#include "utility/arithmetic.hpp"
+#include "utility/binary_io.hpp"
+
+#include <boost/cstdint.hpp>
 #include <boost/operators.hpp>
 #include <iosfwd>
+#include <stdexcept>
+#include <string>
 
 template<class T>
 class polynomial_two
@@ -34,7 +41,8 @@ public:
   };
 
 private:
-  typedef std::vector<element> elements_type;
+  typedef std::vector<element, memory::arena_allocator<element> >
+    elements_type;
   elements_type elements_;
 
 public:
@@ -224,11 +232,32 @@ public:
     polynomial_two<T> result;
     for (auto const& e1 : rhs.elements_)
       for (auto const& e2 : elements_)
-        result.coeff(e1.i + e2.i, e1.j + e2.j) += e1.c * e2.c;
+        addmul(result.coeff(e1.i + e2.i, e1.j + e2.j), e1.c, e2.c);
+    result.cleanup();
     swap(result);
     return *this;
   }
 
+  // fused multiply-accumulate, r += a * b and r -= a * b accumulating
+  // directly into r's coefficients (r must not alias a or b)
+  friend void addmul(polynomial_two<T>& r,
+    polynomial_two<T> const& a, polynomial_two<T> const& b)
+  {
+    for (auto const& e1 : a.elements_)
+      for (auto const& e2 : b.elements_)
+        addmul(r.coeff(e1.i + e2.i, e1.j + e2.j), e1.c, e2.c);
+    r.cleanup();
+  }
+
+  friend void submul(polynomial_two<T>& r,
+    polynomial_two<T> const& a, polynomial_two<T> const& b)
+  {
+    for (auto const& e1 : a.elements_)
+      for (auto const& e2 : b.elements_)
+        submul(r.coeff(e1.i + e2.i, e1.j + e2.j), e1.c, e2.c);
+    r.cleanup();
+  }
+
   // unary
 
   const polynomial_two<T> operator-() const
@@ -249,6 +278,19 @@ public:
     return result;
   }
 
+  // exact division, every term must have Q^k at least
+  const polynomial_two<T> divided_by_Q(index k) const
+  {
+    polynomial_two<T> result;
+    for (auto const& e : elements_) {
+      if (e.i < k)
+        throw std::domain_error("polynomial not divisible by Q^" + std::to_string(k));
+      result.coeff(e.i - k, e.j) = e.c;
+    }
+    result.cleanup();
+    return result;
+  }
+
   const polynomial_two<T> times_v() const
   {
     polynomial_two<T> result;
@@ -257,6 +299,30 @@ public:
     return result;
   }
   
+  friend void write_binary(std::FILE* f, polynomial_two<T> const& p)
+  {
+    using binary_io::write_binary;
+    write_binary(f, boost::uint32_t(p.elements_.size()));
+    for (auto const& e : p.elements_) {
+      write_binary(f, e.i);
+      write_binary(f, e.j);
+      write_binary(f, e.c);
+    }
+  }
+
+  friend void read_binary(std::FILE* f, polynomial_two<T>& p)
+  {
+    using binary_io::read_binary;
+    boost::uint32_t n;
+    read_binary(f, n);
+    p.elements_.resize(n);
+    for (auto& e : p.elements_) {
+      read_binary(f, e.i);
+      read_binary(f, e.j);
+      read_binary(f, e.c);
+    }
+  }
+
   friend
   std::ostream& operator<<(std::ostream& o, polynomial_two<T> const& p)
   {
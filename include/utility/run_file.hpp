@@ -0,0 +1,82 @@
+/*
+ *  run_file.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef RUN_FILE_HPP
+#define RUN_FILE_HPP
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace external {
+
+  // An anonymous temporary file holding a sequence of runs. The file is
+  // unlinked as soon as it is created, so it goes away with the process
+  // whatever happens.
+  class run_file {
+    std::FILE* f_;
+
+    run_file(run_file const&);
+    run_file& operator=(run_file const&);
+
+  public:
+    explicit run_file(std::string const& dir)
+    {
+      std::string path = (dir.empty() ? std::string(".") : dir) + "/tutte-run-XXXXXX";
+      std::vector<char> name(path.begin(), path.end());
+      name.push_back('\0');
+      int fd = ::mkstemp(name.data());
+      if (fd == -1)
+        throw std::runtime_error("cannot create a run file in " + dir + ": " + std::strerror(errno));
+      ::unlink(name.data());
+      f_ = ::fdopen(fd, "w+b");
+      if (not f_) {
+        ::close(fd);
+        throw std::runtime_error("cannot open a run file");
+      }
+    }
+
+    ~run_file()
+    {
+      std::fclose(f_);
+    }
+
+    // positions the file for appending a run
+    std::FILE* append()
+    {
+      std::fseek(f_, 0, SEEK_END);
+      return f_;
+    }
+
+    // positions the file for reading all runs from the start
+    std::FILE* read() const
+    {
+      std::fflush(f_);
+      std::fseek(f_, 0, SEEK_SET);
+      return f_;
+    }
+
+    std::size_t bytes() const
+    {
+      std::fseek(f_, 0, SEEK_END);
+      return std::ftell(f_);
+    }
+  };
+}
+
+#endif
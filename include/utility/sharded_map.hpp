@@ -0,0 +1,256 @@
+/*
+ *  sharded_map.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef SHARDED_MAP_HPP
+#define SHARDED_MAP_HPP
+
+#include "utility/arena_map.hpp"
+#include "utility/binary_io.hpp"
+#include "utility/run_file.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace parallel {
+
+  // A map split in a power of two number of shards, each an arena_map
+  // with its own arena. A key always lives in the shard picked by the
+  // high bits of its hash, so shards are disjoint and can be built by
+  // different threads without any locking. A single shard behaves like
+  // a plain map.
+  //
+  // A shard can also be spilled to disk: its entries are appended as a
+  // run to the shard's run file and the shard is emptied. Runs of the
+  // same shard may share keys, their values are added up when the
+  // shard is loaded back. Iterators only visit resident shards, use
+  // for_each_shard to visit spilled shards too.
+
+  template<class Key, class T, class Hash = boost::hash<Key>,
+           class Pred = std::equal_to<Key> >
+  class sharded_map {
+  public:
+    typedef memory::arena_map<Key, T, Hash, Pred> shard_type;
+    typedef typename shard_type::value_type value_type;
+    typedef typename shard_type::size_type size_type;
+
+  private:
+    std::vector<shard_type> shards_;
+    unsigned int shift_;
+    std::vector<std::unique_ptr<external::run_file> > runs_;
+    std::vector<size_type> spilled_;  // entries in the runs of each shard
+
+    void write_run(unsigned int i)
+    {
+      using binary_io::write_binary;
+      std::FILE* f = runs_[i]->append();
+      write_binary(f, boost::uint64_t(shards_[i].size()));
+      for (auto const& e : shards_[i]) {
+        write_binary(f, e.first);
+        write_binary(f, e.second);
+      }
+    }
+
+  public:
+    class const_iterator
+      : public std::iterator<std::forward_iterator_tag, value_type const>
+    {
+      typedef typename shard_type::const_iterator inner;
+      typename std::vector<shard_type>::const_iterator shard_, last_;
+      inner it_;
+
+      void skip_empty()
+      {
+        while (shard_ != last_ and it_ == shard_->end()) {
+          if (++shard_ != last_)
+            it_ = shard_->begin();
+        }
+      }
+
+    public:
+      const_iterator() {}
+      const_iterator(std::vector<shard_type> const& s, bool end)
+        : shard_(end ? s.end() : s.begin()), last_(s.end())
+      {
+        if (shard_ != last_) {
+          it_ = shard_->begin();
+          skip_empty();
+        }
+      }
+
+      value_type const& operator*() const { return *it_; }
+      value_type const* operator->() const { return &*it_; }
+
+      const_iterator& operator++()
+      {
+        ++ it_;
+        skip_empty();
+        return *this;
+      }
+
+      const_iterator operator++(int)
+      {
+        const_iterator tmp(*this);
+        ++ *this;
+        return tmp;
+      }
+
+      bool operator==(const_iterator const& o) const
+      {
+        return shard_ == o.shard_ and (shard_ == last_ or it_ == o.it_);
+      }
+
+      bool operator!=(const_iterator const& o) const
+      {
+        return not (*this == o);
+      }
+    };
+
+    typedef const_iterator iterator;
+
+    // num_shards must be a power of two
+    explicit sharded_map(unsigned int num_shards = 1)
+      : shards_(num_shards), shift_(64), runs_(num_shards), spilled_(num_shards)
+    {
+      while (num_shards > 1) {
+        -- shift_;
+        num_shards >>= 1;
+      }
+    }
+
+    unsigned int num_shards() const { return shards_.size(); }
+
+    shard_type& shard(unsigned int i) { return shards_[i]; }
+    shard_type const& shard(unsigned int i) const { return shards_[i]; }
+
+    unsigned int shard_index(Key const& k) const
+    {
+      if (shift_ == 64)
+        return 0;
+      boost::uint64_t h = Hash()(k);
+      return (h * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+
+    // counts keys appearing in more than one run of a shard more than
+    // once, it is exact after consolidate()
+    size_type size() const
+    {
+      size_type n = 0;
+      for (unsigned int i = 0; i < shards_.size(); ++i)
+        n += shards_[i].size() + spilled_[i];
+      return n;
+    }
+
+    // memory held by resident shards
+    std::size_t bytes() const
+    {
+      std::size_t n = 0;
+      for (auto const& s : shards_)
+        n += s.get_arena().bytes_reserved();
+      return n;
+    }
+
+    // disk space held by spilled shards
+    std::size_t spilled_bytes() const
+    {
+      std::size_t n = 0;
+      for (auto const& r : runs_) {
+        if (r)
+          n += r->bytes();
+      }
+      return n;
+    }
+
+    bool spilled(unsigned int i) const { return bool(runs_[i]); }
+
+    bool resident() const
+    {
+      for (auto const& r : runs_) {
+        if (r)
+          return false;
+      }
+      return true;
+    }
+
+    // appends the entries of shard i to its run file, in dir
+    void spill(unsigned int i, std::string const& dir)
+    {
+      if (shards_[i].empty())
+        return;
+      if (not runs_[i])
+        runs_[i].reset(new external::run_file(dir));
+      write_run(i);
+      spilled_[i] += shards_[i].size();
+      shard_type().swap(shards_[i]);
+    }
+
+    // the content of shard i, adding up its runs
+    shard_type load(unsigned int i) const
+    {
+      using binary_io::read_binary;
+      shard_type s(shards_[i]);
+      if (not runs_[i])
+        return s;
+      memory::arena::scope scope(s.get_arena());
+      std::FILE* f = runs_[i]->read();
+      boost::uint64_t n;
+      while (std::fread(&n, sizeof(n), 1, f) == 1) {
+        for (boost::uint64_t k = 0; k < n; ++k) {
+          Key key;
+          T value;
+          read_binary(f, key);
+          read_binary(f, value);
+          auto it = s.find(key);
+          if (it == s.end())
+            s.emplace(std::move(key), std::move(value));
+          else
+            it->second += value;
+        }
+      }
+      return s;
+    }
+
+    // makes shard i resident again, merging its runs
+    void consolidate(unsigned int i)
+    {
+      if (not runs_[i])
+        return;
+      shard_type s = load(i);
+      runs_[i].reset();
+      spilled_[i] = 0;
+      shards_[i].swap(s);
+    }
+
+    // calls f with each shard, spilled shards are loaded one at a time
+    template<class F>
+    void for_each_shard(F f) const
+    {
+      for (unsigned int i = 0; i < shards_.size(); ++i) {
+        if (runs_[i])
+          f(static_cast<shard_type const&>(load(i)));
+        else
+          f(shards_[i]);
+      }
+    }
+
+    bool empty() const { return size() == 0; }
+
+    const_iterator begin() const { return const_iterator(shards_, false); }
+    const_iterator end()   const { return const_iterator(shards_, true); }
+  };
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ *  thread_pool.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+  // A work-stealing thread pool. Each worker has its own deque: it
+  // pushes and pops tasks at the back (depth first), idle workers steal
+  // from the front of the others. A pool of size n runs n - 1 workers,
+  // the n-th thread being whoever waits on it, since waiting threads
+  // execute pending tasks too.
+
+  class thread_pool {
+  public:
+    typedef std::function<void ()> task;
+
+  private:
+    struct queue {
+      std::mutex m;
+      std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<queue> > queues_;
+    std::vector<std::thread> threads_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::atomic<unsigned int> pending_;
+    std::atomic<unsigned int> next_;
+    bool stop_;
+
+    // index of the calling thread's queue, if it is one of our workers
+    static int& worker_index(thread_pool const* p)
+    {
+      static thread_local thread_pool const* pool = nullptr;
+      static thread_local int index = -1;
+      if (pool != p) {
+        pool = p;
+        index = -1;
+      }
+      return index;
+    }
+
+    bool pop(task& t)
+    {
+      unsigned int const n = queues_.size();
+      int const self = worker_index(this);
+      unsigned int const first = self >= 0 ? self : next_++ % n;
+      for (unsigned int k = 0; k < n; ++k) {
+        unsigned int const i = (first + k) % n;
+        queue& q = *queues_[i];
+        std::lock_guard<std::mutex> lock(q.m);
+        if (q.tasks.empty())
+          continue;
+        if ((int) i == self) {
+          t = std::move(q.tasks.back());
+          q.tasks.pop_back();
+        } else {
+          t = std::move(q.tasks.front());
+          q.tasks.pop_front();
+        }
+        -- pending_;
+        return true;
+      }
+      return false;
+    }
+
+    void work(int index)
+    {
+      worker_index(this) = index;
+      while (true) {
+        task t;
+        if (pop(t)) {
+          t();
+          continue;
+        }
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&] { return stop_ or pending_ > 0; });
+        if (stop_ and pending_ == 0)
+          return;
+      }
+    }
+
+  public:
+    explicit thread_pool(unsigned int n)
+      : pending_(0), next_(0), stop_(false)
+    {
+      unsigned int const workers = n > 1 ? n - 1 : 0;
+      for (unsigned int i = 0; i < std::max(workers, 1u); ++i)
+        queues_.emplace_back(new queue);
+      for (unsigned int i = 0; i < workers; ++i)
+        threads_.emplace_back(&thread_pool::work, this, i);
+    }
+
+    ~thread_pool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      for (auto& t : threads_)
+        t.join();
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    // number of threads working when someone waits on the pool
+    unsigned int size() const
+    {
+      return threads_.size() + 1;
+    }
+
+    void submit(task t)
+    {
+      int const self = worker_index(this);
+      unsigned int const i = self >= 0 ? self : next_++ % queues_.size();
+      {
+        std::lock_guard<std::mutex> lock(queues_[i]->m);
+        queues_[i]->tasks.push_back(std::move(t));
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        ++ pending_;
+      }
+      cv_.notify_one();
+    }
+
+    // runs pending tasks on the calling thread until done() holds,
+    // done() must become true as a consequence of some task completing
+    // and that task must call notify()
+    template<class Predicate>
+    void wait_until(Predicate done)
+    {
+      while (not done()) {
+        task t;
+        if (pop(t)) {
+          t();
+          continue;
+        }
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&] { return pending_ > 0 or done(); });
+      }
+    }
+
+    void notify()
+    {
+      { std::lock_guard<std::mutex> lock(m_); }
+      cv_.notify_all();
+    }
+  };
+
+  // A set of tasks that can be waited for as a whole. The first
+  // exception thrown by a task is rethrown by wait().
+  class task_group {
+    thread_pool& pool_;
+    std::atomic<unsigned int> count_;
+    std::mutex m_;
+    std::exception_ptr error_;
+
+  public:
+    explicit task_group(thread_pool& pool) : pool_(pool), count_(0) {}
+
+    ~task_group()
+    {
+      pool_.wait_until([&] { return count_ == 0; });
+    }
+
+    template<class F>
+    void run(F f)
+    {
+      ++ count_;
+      pool_.submit([this, f] {
+        try {
+          f();
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(m_);
+          if (not error_)
+            error_ = std::current_exception();
+        }
+        // the group may be gone as soon as the count drops to zero
+        thread_pool& pool = pool_;
+        if (-- count_ == 0)
+          pool.notify();
+      });
+    }
+
+    void wait()
+    {
+      pool_.wait_until([&] { return count_ == 0; });
+      if (error_)
+        std::rethrow_exception(error_);
+    }
+  };
+}
+
+#endif
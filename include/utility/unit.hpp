@@ -0,0 +1,49 @@
+/*
+ *  unit.hpp
+ *
+ *
+ *  Copyright (c) 2014, Andrea Bedini <andrea.bedini@gmail.com>.
+ *
+ *  Distributed under the terms of the Modified BSD License.
+ *  The full license is in the file COPYING, distributed as part of
+ *  this software.
+ *
+ */
+
+#ifndef UNIT_HPP
+#define UNIT_HPP
+
+#include <cstdio>
+#include <ostream>
+
+// A weight that carries no information: every operation on it is a
+// no-op. Running the table operators with it enumerates the reachable
+// connectivity states without doing any arithmetic, which is how
+// estimate::count predicts the size of the tables.
+
+namespace weightless {
+
+  class unit {
+  public:
+    unit() {}
+
+    template<class T>
+    explicit unit(T const&) {}
+
+    unit& operator+=(unit const&) { return *this; }
+    unit& operator*=(unit const&) { return *this; }
+
+    friend unit operator*(unit const&, unit const&) { return unit(); }
+    friend void addmul(unit&, unit const&, unit const&) {}
+
+    friend void write_binary(std::FILE*, unit const&) {}
+    friend void read_binary(std::FILE*, unit&) {}
+
+    friend std::ostream& operator<<(std::ostream& o, unit const&)
+    {
+      return o << "1";
+    }
+  };
+}
+
+#endif
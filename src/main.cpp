@@ -11,28 +11,47 @@
  *
  */
 
+#include "blocks.hpp"
+#include "checkpoint.hpp"
 #include "chinese_remainder.hpp"
+#include "conditioning.hpp"
+#include "deletion_contraction.hpp"
+#include "estimate.hpp"
 #include "graph_type.hpp"
+#include "lattice.hpp"
 #include "parse_graph.hpp"
+#include "preprocess.hpp"
+#include "profiler.hpp"
 #include "transfer.hpp"
+#include "tree_decomposition/cost_model.hpp"
+#include "tree_decomposition/edge_placement.hpp"
+#include "tree_decomposition/exact.hpp"
 #include "tree_decomposition/heuristics.hpp"
+#include "tree_decomposition/pace.hpp"
+#include "tree_decomposition/portfolio.hpp"
+#include "tree_decomposition/simplify.hpp"
 #include "tree_decomposition/tree_decomposition.hpp"
 #include "tutte.hpp"
 #include "utility/gmp.hpp"
 #include "utility/polynomial_two.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/unit.hpp"
 
 #include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
-#include <boost/property_map/vector_property_map.hpp>
 #include <boost/range/irange.hpp>
 #include <boost/range/algorithm/equal.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/program_options.hpp>
 #include <boost/tokenizer.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -66,33 +85,201 @@ bool validate_elimination_order(Range range, Graph const& g)
 }
 
 /*
- *  The algorithm to run, dependent on the weight type
+ *  parse a memory size in MB, or with a K, M or G suffix
+ */
+bool parse_memory_size(std::string const& s, std::size_t& bytes)
+{
+  std::size_t n = 0;
+  auto it = s.begin();
+  if (it == s.end() or not std::isdigit(*it))
+    return false;
+  while (it != s.end() and std::isdigit(*it))
+    n = 10 * n + (*it++ - '0');
+  unsigned int shift = 20;
+  if (it != s.end()) {
+    switch (std::toupper(*it++)) {
+    case 'K': shift = 10; break;
+    case 'M': shift = 20; break;
+    case 'G': shift = 30; break;
+    default: return false;
+    }
+  }
+  bytes = n << shift;
+  return it == s.end();
+}
+
+/*
+ *  The computation, for a given weight type: the transfer over the tree
+ *  decomposition of each subproblem of conditioning, times
+ *  deletion-contraction on the components left to it
  */
 
-template<typename T>
-using algo = tutte<polynomial_two<T>>;
+struct part {
+  tree_decomposition::bag_ptr td;
+  preprocess::edge_weights weights;
+  // the subproblem weighs sum_j contracted[j] v^j
+  std::vector<std::size_t> contracted;
+};
+
+template<class T, class U>
+struct computation {
+  T Q;
+  U v;
+  std::vector<part> const* parts;
+  transfer::options opt;
+  parallel::thread_pool* pool;
+  std::size_t split, memory_limit;
+  std::string spill_dir;
+  std::vector<graph_type> const* dense;
+  // of the last run
+  deletion_contraction::statistics* dc_stats;
+
+  template<class Weight>
+  Weight solve(part const& p) const
+  {
+    Weight z = transfer::transfer(
+      tutte<Weight>(Q, v, pool, split, memory_limit, spill_dir, &p.weights), p.td, opt);
+    if (p.contracted.size() == 1 and p.contracted[0] == 1)
+      return z;
+    Weight c, power(1), x(v);
+    for (auto n : p.contracted) {
+      addmul(c, Weight((unsigned int) n), power);
+      power *= x;
+    }
+    z *= c;
+    return z;
+  }
+
+  template<class Weight>
+  Weight run() const
+  {
+    std::vector<Weight> z(parts->size());
+    if (pool and parts->size() > 1) {
+      parallel::task_group group(*pool);
+      for (std::size_t i = 0; i < parts->size(); ++i)
+        group.run([this, &z, i] { z[i] = solve<Weight>((*parts)[i]); });
+      group.wait();
+    } else {
+      for (std::size_t i = 0; i < parts->size(); ++i)
+        z[i] = solve<Weight>((*parts)[i]);
+    }
+    Weight result;
+    for (auto const& x : z)
+      result += x;
+    if (not dense->empty()) {
+      deletion_contraction::engine<Weight> dc(Q, v);
+      for (auto const& h : *dense)
+        result *= dc.compute(h);
+      *dc_stats = dc.stats();
+    }
+    return result;
+  }
+};
+
+template<class T, class U>
+computation<T, U> make_computation(T const& Q, U const& v, std::vector<part> const* parts,
+  transfer::options const& opt, parallel::thread_pool* pool, std::size_t split,
+  std::size_t memory_limit, std::string const& spill_dir,
+  std::vector<graph_type> const* dense, deletion_contraction::statistics* dc_stats)
+{
+  return computation<T, U>{Q, v, parts, opt, pool, split, memory_limit, spill_dir, dense,
+    dc_stats};
+}
+
+/*
+ *  the partition functions of a lattice strip, one length per line
+ */
+template<class Weight>
+void print_lattice(lattice::transfer_matrix& tm, Weight const& Q, Weight const& v,
+  unsigned int length)
+{
+  for (auto const& z : tm.partition_functions(Q, v, length))
+    std::cout << z << "\n";
+}
 
 int main (int argc, char *argv[])
 {
+  gmp::use_arena_allocator();
+
+  char const* tmpdir = std::getenv("TMPDIR");
+
   namespace po = boost::program_options;
   po::options_description desc("Allowed options");
   desc.add_options()
     ("help,h", "Produce help message")
     ("input-file", po::value<std::string>(), "Read the graph from a file.")
+    ("lattice", po::value<std::string>(),
+     "Compute the strips of the square lattice of width L and lengths 1 to M, "
+     "given as LxM, with a transfer matrix, instead of reading a graph.")
+    ("periodic", "With lattice, make the strips periodic across the width (cylinders).")
+    ("no-symmetry", "With lattice, keep every state rather than one of each pair of "
+     "mirror images.")
     // tree decomposition options
     ("degree", "Use greedy degree algorithm [default].")
     ("fill-in", "Use greedy fill-in algorithm.")
     ("local-degree", "Use 'local' greedy degree algorithm.")
     ("local-fill-in", "Use 'local' greedy fill-in algorithm.")
+    ("min-cost", "Minimise a cost model of the computation with greedy and local search.")
+    ("min-cost-iterations", po::value<unsigned int>()->default_value(2000),
+     "Local search moves tried by min-cost, and by portfolio.")
+    ("portfolio", po::value<double>(),
+     "Run all the heuristics, with random restarts, on all threads for this many "
+     "seconds and keep the cheapest order.")
+    ("exact-order", "Search for an elimination order of minimum width by branch and bound.")
+    ("exact-time-limit", po::value<double>()->default_value(60),
+     "Seconds after which exact-order keeps the best order found so far.")
+    ("seed", po::value<unsigned int>()->default_value(0),
+     "Random seed for min-cost and portfolio.")
     ("elimination-order", po::value<std::string>(), "Specify a vertex elimination order.")
+    ("td-file", po::value<std::string>(),
+     "Read the tree decomposition from a file in PACE .td format.")
+    ("td-out", po::value<std::string>(),
+     "Write the tree decomposition to a file in PACE .td format.")
+    ("engine", po::value<std::string>()->default_value("auto"),
+     "How to compute each block: transfer (on a tree decomposition), dc "
+     "(deletion-contraction) or auto (dc for small dense blocks).")
+    ("condition", po::value<unsigned int>()->default_value(0),
+     "Condition on the edges between up to this many pairs of vertices, chosen to "
+     "narrow the tree decomposition, and run the transfer on each subproblem.")
+    ("no-blocks", "Do not split the graph into its biconnected components.")
+    ("no-preprocess", "Do not merge parallel edges before the tree decomposition.")
+    ("reduce-series", "Also merge edges in series, removing their middle vertex, before "
+     "the tree decomposition.")
+    ("subtree-reuse", "Reuse the table of a subtree for the identical ones, rather than "
+     "transferring each.")
+    ("no-simplify", "Do not contract redundant bags of the tree decomposition.")
+    ("no-edge-placement", "Join each edge in the bag where the decomposition puts it, "
+     "rather than in the smallest bag holding its ends.")
+    ("keep-root", "Do not reroot the tree decomposition to reduce memory usage.")
     ("print-tree", "Print tree decomposition.")
     ("tree-only", "Print tree decomposition and exit.")
+    ("estimate", "Print the predicted table sizes, work and peak memory, and exit.")
+    ("estimate-method", po::value<std::string>()->default_value("bell"),
+     "How to predict the number of states: bell (any graph), catalan "
+     "(planar graphs, bags on a face) or count (run without weights).")
+    ("max-states", po::value<double>(),
+     "Refuse to run if the predicted peak number of table entries exceeds this.")
     // tutte options
     ("flow,f", "Compute the flow polynomial")
     ("chromatic,c", "Compute the chromatic polynomial")
     ("Q,Q", po::value<int32_t>(), "Fix Q value, to be used with v")
     ("v,v", po::value<int32_t>(), "Fix v value, to be used with Q")
     ("chinese-remainder", "Use the chinese remainder trick.")
+    // parallelism
+    ("threads", po::value<unsigned int>()->default_value(1), "Number of threads.")
+    ("split-threshold", po::value<std::size_t>()->default_value(4096),
+     "Split table operators with at least this much work across threads.")
+    // memory
+    ("memory-limit", po::value<std::string>()->default_value("0"),
+     "Spill tables to disk to stay within about this many MB, "
+     "or KB, GB with a K, G suffix (0 = no limit).")
+    ("spill-dir", po::value<std::string>()->default_value(tmpdir ? tmpdir : "/tmp"),
+     "Directory for spilled tables.")
+    ("checkpoint-dir", po::value<std::string>(),
+     "Save completed subtrees in this directory, and resume from there.")
+    // diagnostics
+    ("profile-out", po::value<std::string>(),
+     "Write a JSON report of every table operator to a file.")
     ;
 
   po::variables_map vm;
@@ -115,15 +302,83 @@ int main (int argc, char *argv[])
   check += vm.count("fill-in");
   check += vm.count("local-degree");
   check += vm.count("local-fill-in");
+  check += vm.count("min-cost");
+  check += vm.count("portfolio");
+  check += vm.count("exact-order");
   check += vm.count("elimination-order");
+  check += vm.count("td-file");
 
   if (check > 1) {
     std::cerr <<
-      "error: please specify at most one between degree, fill-in,"
-      "local-degree, local-fill-in and elimination-order\n";
+      "error: please specify at most one between degree, fill-in, "
+      "local-degree, local-fill-in, min-cost, portfolio, exact-order, "
+      "elimination-order and td-file\n";
     return 1;
   }
 
+  if (vm.count("lattice")) {
+    lattice::strip s;
+    unsigned int length;
+    if (not lattice::parse_size(vm["lattice"].as<std::string>(), s.width, length)) {
+      std::cerr << "error: lattice size must be LxM\n";
+      return 1;
+    }
+    if (s.width > lattice::max_width) {
+      std::cerr << "error: lattice width must be at most " << lattice::max_width << "\n";
+      return 1;
+    }
+    s.periodic = vm.count("periodic");
+    if (s.periodic and s.width < 3) {
+      std::cerr << "error: a periodic strip must be at least 3 wide\n";
+      return 1;
+    }
+    if (vm.count("input-file")) {
+      std::cerr << "error: lattice reads no graph\n";
+      return 1;
+    }
+    // the options of the tree decomposition and of the transfer over it
+    static char const* const unused[] = {
+      "degree", "fill-in", "local-degree", "local-fill-in", "min-cost",
+      "min-cost-iterations", "portfolio", "exact-order", "exact-time-limit", "seed",
+      "elimination-order", "td-file", "td-out", "engine", "condition", "no-blocks",
+      "no-preprocess", "reduce-series", "subtree-reuse", "no-simplify",
+      "no-edge-placement", "keep-root", "print-tree", "tree-only", "estimate",
+      "estimate-method", "chinese-remainder", "threads", "split-threshold",
+      "memory-limit", "spill-dir", "checkpoint-dir", "profile-out"
+    };
+    for (auto name : unused) {
+      if (vm.count(name) and not vm[name].defaulted()) {
+        std::cerr << "error: lattice does not go with " << name << "\n";
+        return 1;
+      }
+    }
+    if (vm.count("max-states") and lattice::predicted_peak(s) > vm["max-states"].as<double>()) {
+      std::cerr << "error: predicted peak of " << lattice::predicted_peak(s)
+                << " table entries exceeds the limit\n";
+      return 2;
+    }
+    lattice::transfer_matrix tm(s, not vm.count("no-symmetry"));
+    if (vm.count("Q") and vm.count("v")) {
+      std::cerr << "Running with fixed values of Q and v\n";
+      print_lattice(tm, gmp::mpz_int(vm["Q"].as<int32_t>()),
+        gmp::mpz_int(vm["v"].as<int32_t>()), length);
+    } else {
+      using weight = polynomial_two<gmp::mpz_int>;
+      weight Q = weight::Q(), v = weight::v();
+      if (vm.count("flow"))
+        v = -Q;
+      else if (vm.count("chromatic"))
+        v = weight(-1);
+      print_lattice(tm, Q, v, length);
+    }
+    std::cerr << "Lattice strip of width " << s.width << (s.periodic ? " (periodic)" : "")
+              << ": " << tm.num_states() << " states, " << tm.num_orbits() << " orbits under "
+              << tm.num_symmetries() << " symmetries, at most " << tm.largest_vector()
+              << " kept, " << tm.num_entries() << " matrix entries, "
+              << tm.num_coefficients() << " coefficients\n";
+    return 0;
+  }
+
   graph_type g;
   try {
     std::string s;
@@ -147,58 +402,331 @@ int main (int argc, char *argv[])
   std::cerr << "Graph with " << num_vertices(g) << " vertices and "
             << num_edges(g) << " edges.\n";
 
-  // check for connectedness
-  auto component = boost::make_vector_property_map<int>(
-    get(boost::vertex_index, g));
-  auto num = connected_components(g, component);
-  if (num > 1) {
-    std::cerr << "The input graph is not connected. A connected input is required\n";
+  // elimination orders and decompositions given are on the vertices of
+  // the input graph
+  bool const renumber = not (vm.count("elimination-order") or vm.count("td-file"));
+
+  // g becomes the disjoint union of its blocks, whose partition
+  // function is that of the input times Q^shift
+  unsigned int shift = 0;
+  if (renumber and not vm.count("no-blocks")) {
+    blocks::stats parts;
+    g = blocks::split(g, parts);
+    shift = parts.blocks - parts.components;
+    std::cerr << "Split into " << parts.blocks << " blocks (" << parts.components
+              << " connected components), the largest with " << parts.largest_vertices
+              << " vertices and " << parts.largest_edges << " edges.\n";
+  }
+
+  // components of g left to deletion-contraction, taken out of g
+  std::vector<graph_type> dense;
+  std::string const engine = vm["engine"].as<std::string>();
+  if (engine != "auto" and engine != "transfer" and engine != "dc") {
+    std::cerr << "error: unknown engine " << engine << "\n";
+    return 1;
+  }
+  if (engine == "dc" and not renumber) {
+    std::cerr << "error: the dc engine takes no elimination order or tree decomposition\n";
+    return 1;
+  }
+  if (vm["condition"].as<unsigned int>() > 0 and (not renumber or vm.count("estimate")
+      or vm.count("max-states") or vm.count("checkpoint-dir") or vm.count("profile-out")
+      or vm.count("td-out"))) {
+    std::cerr << "error: condition takes no elimination order or tree decomposition, "
+      "and does not go with estimate, max-states, checkpoint-dir, profile-out and td-out\n";
+    return 1;
+  }
+  // merging parallel edges keeps the vertices, the rest renumbers them
+  if (vm.count("td-out") and renumber and (not vm.count("no-blocks")
+      or vm.count("reduce-series") or engine != "transfer")) {
+    std::cerr << "error: td-out writes a decomposition of the input graph, which needs "
+      "no-blocks and engine transfer, and no reduce-series\n";
     return 1;
   }
+  if (renumber and engine != "transfer") {
+    std::vector<unsigned int> component;
+    unsigned int const count = blocks::components(g, component);
+    std::vector<bool> chosen(count, false), keep(num_vertices(g));
+    for (unsigned int c = 0; c < count; ++c) {
+      for (unsigned int i = 0; i < keep.size(); ++i)
+        keep[i] = component[i] == c;
+      graph_type h = blocks::induced(g, keep);
+      if (engine == "dc" or deletion_contraction::preferable(h)) {
+        chosen[c] = true;
+        dense.push_back(std::move(h));
+      }
+    }
+    if (not dense.empty()) {
+      for (unsigned int i = 0; i < keep.size(); ++i)
+        keep[i] = not chosen[component[i]];
+      g = blocks::induced(g, keep);
+      std::cerr << "Deletion-contraction on " << dense.size() << " of " << count
+                << " blocks\n";
+    }
+  }
 
-  std::vector<unsigned int> order(num_vertices(g));
-
-  if (vm.count("fill-in")) {
-    heuristics::greedy_fillin_order(g, order.begin());
-  } else if (vm.count("local-degree")) {
-    heuristics::greedy_local_degree_order(g, order.begin());
-  } else if (vm.count("local-fill-in")) {
-    heuristics::greedy_local_fillin_order(g, order.begin());
-  } else if (vm.count("elimination-order")) {
-    // parse the std::string
-    std::string s = vm["elimination-order"].as<std::string>();
-    parse_elimination_order(s, order.begin());
-    bool valid = validate_elimination_order(order, g);
-    if (not valid) {
-      std::cerr << "error: elimination order not valid\n";
-      return 1;
+  // g becomes the quotients of conditioning on some of its edges, each
+  // run on its own
+  std::vector<graph_type> graphs;
+  std::vector<std::vector<std::size_t> > contracted;
+  auto const condition = vm["condition"].as<unsigned int>();
+  if (condition > 0) {
+    conditioning::stats narrowed;
+    auto const chosen = conditioning::choose(g, condition, &narrowed);
+    for (auto const& x : conditioning::enumerate(g, chosen)) {
+      graphs.push_back(conditioning::quotient(g, chosen, x));
+      contracted.push_back(x.contracted);
     }
-    std::cerr << "Vertex ordering: " << s << "\n";
+    std::cerr << "Conditioning on " << chosen.size() << " edges between " << narrowed.pairs
+              << " of " << condition << " pairs: " << graphs.size()
+              << " subproblems, width " << narrowed.width_before << " down to "
+              << narrowed.width_after << ", estimated work " << narrowed.work_before
+              << " to " << narrowed.work_after << "\n";
   } else {
-    heuristics::greedy_degree_order(g, order.begin());
+    graphs.push_back(g);
+    contracted.push_back(std::vector<std::size_t>(1, 1));
   }
+  bool const verbose = graphs.size() == 1;
+
+  std::unique_ptr<parallel::thread_pool> pool;
+  auto threads = vm["threads"].as<unsigned int>();
+  if (threads > 1)
+    pool.reset(new parallel::thread_pool(threads));
+
+  std::vector<part> parts(graphs.size());
+  std::vector<unsigned int> order;
+  tree_decomposition::bag_ptr td;
+  tree_decomposition::simplify_stats simplified;
+  double predicted_peak = 0;
+  std::size_t edges_moved = 0;
+  for (std::size_t i = 0; i < graphs.size(); ++i) {
+    g = std::move(graphs[i]);
+    preprocess::edge_weights& weights = parts[i].weights;
+    parts[i].contracted = contracted[i];
+    if (renumber and not vm.count("no-preprocess")) {
+      preprocess::stats reduced;
+      g = preprocess::reduce(g, weights, vm.count("reduce-series"), &reduced);
+      if (verbose)
+        std::cerr << "Preprocessing: " << reduced.parallel << " parallel edges merged, "
+                  << reduced.series << " vertices in series removed, leaving "
+                  << reduced.vertices_after << " vertices and "
+                  << reduced.edges_after << " edges.\n";
+    }
+
+    order.assign(num_vertices(g), 0);
+    td.reset();
+
+    if (vm.count("td-file")) {
+      std::string filename = vm["td-file"].as<std::string>();
+      std::ifstream input(filename.c_str(), std::ios_base::in);
+      if (not input.is_open()) {
+        std::cerr << "error: file " << filename << " not found\n";
+        return 1;
+      }
+      try {
+        td = tree_decomposition::read_pace(input, g);
+      } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        return 1;
+      }
+    } else if (vm.count("elimination-order")) {
+      // parse the std::string
+      std::string s = vm["elimination-order"].as<std::string>();
+      parse_elimination_order(s, order.begin());
+      bool valid = validate_elimination_order(order, g);
+      if (not valid) {
+        std::cerr << "error: elimination order not valid\n";
+        return 1;
+      }
+      std::cerr << "Vertex ordering: " << s << "\n";
+    } else {
+      // each block, or component, is ordered on its own; the time limits
+      // of portfolio and exact-order are spread over them by size
+      typedef std::chrono::steady_clock clock;
+      double const seconds = vm.count("portfolio") ? vm["portfolio"].as<double>()
+        : vm["exact-time-limit"].as<double>();
+      auto const deadline = clock::now()
+        + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+      auto time_left = [&] {
+        return std::max(0.0, std::chrono::duration<double>(deadline - clock::now()).count());
+      };
+      heuristics::portfolio_result found{{}, "", 0, 0, 0};
+      heuristics::exact_result exact{{}, 0, 0, true, 0};
+      double heaviest = -1;
+      order = blocks::order_components(g, [&](graph_type const& h, double share) {
+        std::vector<unsigned int> o(num_vertices(h));
+        if (vm.count("fill-in")) {
+          heuristics::greedy_fillin_order(h, o.begin());
+        } else if (vm.count("local-degree")) {
+          heuristics::greedy_local_degree_order(h, o.begin());
+        } else if (vm.count("local-fill-in")) {
+          heuristics::greedy_local_fillin_order(h, o.begin());
+        } else if (vm.count("min-cost")) {
+          heuristics::min_cost_order(h, o.begin(),
+            vm["min-cost-iterations"].as<unsigned int>(), 8, vm["seed"].as<unsigned int>());
+        } else if (vm.count("portfolio")) {
+          auto best = heuristics::portfolio_order(h, share * time_left(),
+            pool.get(), vm["seed"].as<unsigned int>(),
+            vm["min-cost-iterations"].as<unsigned int>());
+          o = std::move(best.order);
+          found.tried += best.tried;
+          found.cost += best.cost;
+          if (best.cost > heaviest) {
+            heaviest = best.cost;
+            found.heuristic = best.heuristic;
+            found.round = best.round;
+          }
+        } else if (vm.count("exact-order")) {
+          auto best = heuristics::exact_order(h, share * time_left());
+          o = std::move(best.order);
+          exact.width = std::max(exact.width, best.width);
+          exact.lower_bound = std::max(exact.lower_bound, best.lower_bound);
+          exact.optimal = exact.optimal and best.optimal;
+          exact.nodes += best.nodes;
+        } else {
+          heuristics::greedy_degree_order(h, o.begin());
+        }
+        return o;
+      });
+      if (vm.count("portfolio")) {
+        std::cerr << "Portfolio: " << found.tried << " orders tried, best for the heaviest "
+                  << "block from " << found.heuristic << " (round " << found.round
+                  << "), estimated work " << found.cost << "\n";
+      } else if (vm.count("exact-order")) {
+        std::cerr << "Exact order: width " << exact.width;
+        if (exact.optimal)
+          std::cerr << " (optimal)";
+        else
+          std::cerr << " (time limit reached, treewidth at least " << exact.lower_bound << ")";
+        std::cerr << ", " << exact.nodes << " nodes searched\n";
+      }
+    }
 
-  auto td = tree_decomposition::build_tree_decomposition(order, g);
+    if (not td)
+      td = tree_decomposition::build_tree_decomposition(order, g);
+    if (not vm.count("no-simplify"))
+      td = tree_decomposition::simplify(td, &simplified);
+    predicted_peak = tree_decomposition::predicted_peak(td);
+    if (not vm.count("keep-root"))
+      td = tree_decomposition::minimize_peak_memory(td);
+    if (not vm.count("no-edge-placement"))
+      edges_moved = tree_decomposition::place_edges(td);
+    parts[i].td = td;
+  }
 
-  if (vm.count("print-tree") or vm.count("tree-only")) {
-    std::cerr << "Elimination order: ";
-    for (auto x : order)
-      std::cerr << x << " ";
-    std::cerr << "\n";
+  bool const print_tree = vm.count("print-tree") or vm.count("tree-only");
+  if (print_tree and not verbose) {
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+      std::cerr << "Subproblem " << i << ": tree decomposition " << parts[i].td
+                << ", width " << max_bag_size(parts[i].td) - 1 << "\n";
+    }
+  } else if (print_tree) {
+    if (not vm.count("td-file")) {
+      std::cerr << "Elimination order: ";
+      for (auto x : order)
+        std::cerr << x << " ";
+      std::cerr << "\n";
+    }
 
     std::cerr << "Tree decomposition: " << td << "\n"
               << "Tree decomposition width: "
-              << max_bag_size(td) - 1 << "\n";
+              << max_bag_size(td) - 1 << "\n"
+              << "Predicted peak number of table entries: "
+              << tree_decomposition::predicted_peak(td)
+              << " (" << predicted_peak << " before rerooting)\n";
+    if (not vm.count("no-simplify")) {
+      std::cerr << "Simplified from " << simplified.bags_before << " bags (estimated work "
+                << simplified.work_before << ") to " << simplified.bags_after
+                << " bags (estimated work " << simplified.work_after << ")\n";
+    }
+    if (not vm.count("no-edge-placement"))
+      std::cerr << "Edges moved to smaller bags: " << edges_moved << "\n";
+  }
+
+  if (vm.count("td-out")) {
+    std::string filename = vm["td-out"].as<std::string>();
+    std::ofstream output(filename.c_str());
+    tree_decomposition::write_pace(output, td, num_vertices(g));
+    if (not output) {
+      std::cerr << "error: cannot write " << filename << "\n";
+      return 1;
+    }
   }
 
   if (vm.count("tree-only"))
     return 0;
 
+  if (vm.count("estimate") or vm.count("max-states")) {
+    estimate::method how;
+    if (not estimate::parse_method(vm["estimate-method"].as<std::string>(), how)) {
+      std::cerr << "error: unknown estimate method\n";
+      return 1;
+    }
+    estimate::report r;
+    if (how == estimate::count) {
+      transfer::options count_opt;
+      count_opt.pool = pool.get();
+      r = estimate::count_states(tutte<weightless::unit>(0, 0), td, count_opt);
+    } else {
+      r = estimate::bounds(td, how);
+    }
+    if (vm.count("estimate"))
+      estimate::print(std::cout, r, print_tree);
+    if (vm.count("max-states") and r.peak > vm["max-states"].as<double>()) {
+      std::cerr << "error: predicted peak of " << r.peak
+                << " table entries exceeds the limit\n";
+      return 2;
+    }
+    if (vm.count("estimate"))
+      return 0;
+  }
+
+  transfer::options opt;
+  transfer::statistics stats;
+  if (print_tree)
+    opt.stats = &stats;
+  std::unique_ptr<profiling::profiler> profile;
+  if (vm.count("profile-out")) {
+    profile.reset(new profiling::profiler(td));
+    profile->info_value("vertices", num_vertices(g));
+    profile->info_value("edges", num_edges(g));
+    profile->info_value("width", max_bag_size(td) - 1);
+    profile->info_value("predicted_peak_entries", tree_decomposition::predicted_peak(td));
+    profile->info_value("threads", vm["threads"].as<unsigned int>());
+    opt.profile = profile.get();
+  }
+  std::unique_ptr<checkpoint::store> checkpoints;
+  if (vm.count("checkpoint-dir")) {
+    checkpoints.reset(new checkpoint::store(vm["checkpoint-dir"].as<std::string>(), td));
+    opt.checkpoints = checkpoints.get();
+  }
+  opt.pool = pool.get();
+  opt.reuse = vm.count("subtree-reuse");
+  auto split = vm["split-threshold"].as<std::size_t>();
+  std::size_t memory_limit;
+  if (not parse_memory_size(vm["memory-limit"].as<std::string>(), memory_limit)) {
+    std::cerr << "error: invalid memory limit\n";
+    return 1;
+  }
+  auto spill_dir = vm["spill-dir"].as<std::string>();
+
+  using gmp::mpz_int;
+  using modular::Zp;
+  deletion_contraction::statistics dc_stats{0, 0, 0};
+  auto print_dc_stats = [&] {
+    if (not dense.empty())
+      std::cerr << "Deletion-contraction: " << dc_stats.calls << " graphs, "
+                << dc_stats.hits << " found in the cache\n";
+  };
   if (vm.count("Q") && vm.count("v")) {
     std::cerr << "Running with fixed values of Q and v\n";
     auto Q = vm["Q"].as<int32_t>();
     auto v = vm["v"].as<int32_t>();
-    chinese_remainder::chinese_remainder<tutte>(td, Q, v);
+    auto result = chinese_remainder::chinese_remainder<mpz_int, Zp>(make_computation(Q, v,
+      &parts, opt, pool.get(), split, memory_limit, spill_dir, &dense, &dc_stats));
+    print_dc_stats();
+    blocks::divide_by_Q(result, Q, shift);
+    std::cout << result << "\n";
   } else {
     auto Q = polynomial_two<int>::Q();
     auto v = polynomial_two<int>::v();
@@ -209,12 +737,32 @@ int main (int argc, char *argv[])
       v = -1;
     }
 
-    if (vm.count("chinese-remainder")) {
-      chinese_remainder::chinese_remainder<algo>(td, Q, v);
-    } else {
-      using gmp::mpz_int;
-      auto result = transfer::transfer(algo<mpz_int>(Q, v), td);
-      std::cout << result << "\n";
+    auto c = make_computation(Q, v, &parts, opt, pool.get(), split, memory_limit,
+      spill_dir, &dense, &dc_stats);
+    polynomial_two<mpz_int> result;
+    if (vm.count("chinese-remainder"))
+      result = chinese_remainder::chinese_remainder<polynomial_two<mpz_int>,
+        polynomial_two<Zp> >(c);
+    else
+      result = c.run<polynomial_two<mpz_int> >();
+    print_dc_stats();
+    blocks::divide_by_Q(result, shift);
+    std::cout << result << "\n";
+  }
+
+  if (print_tree)
+    std::cerr << "Actual peak number of table entries: " << stats.peak() << "\n"
+              << "Subtrees reused: " << stats.reused() << "\n";
+
+  if (profile) {
+    if (print_tree)
+      profile->info_value("peak_entries", stats.peak());
+    std::string filename = vm["profile-out"].as<std::string>();
+    std::ofstream out(filename.c_str());
+    profile->write(out);
+    if (not out) {
+      std::cerr << "error: cannot write " << filename << "\n";
+      return 1;
     }
   }
 }